@@ -0,0 +1,232 @@
+// ---- 전송 무결성 검사용 체크섬 (서버/클라이언트 공용) ----
+// CRC32C: x86-64에서 SSE4.2 crc32 명령을 쓰고, 없으면 slicing-by-8 테이블로 계산
+// SHA-256: 선택적인 강한 해시 (이식 가능한 구현)
+// 전송 본문 뒤에 "CRC|<파일 CRC>|<블록 CRC들>|<SHA-256 또는 ->|\n" 트레일러를 붙여 블록 단위로 검증한다.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace checksum {
+    constexpr size_t CRC_BLOCK_SIZE = 1024 * 1024;  // 블록별 CRC 단위 (1MB)
+
+    struct Crc32cTables {
+        uint32_t t[8][256];
+        Crc32cTables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; ++i)
+                for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+        }
+    };
+    inline uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, size_t len) {
+        static const Crc32cTables tables;
+        const auto& t = tables.t;
+        while (len >= 8) {
+            uint32_t lo, hi;
+            memcpy(&lo, p, 4);
+            memcpy(&hi, p + 4, 4);
+            lo ^= crc;
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                  t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            p += 8;
+            len -= 8;
+        }
+        while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        return crc;
+    }
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    inline uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t len) {
+        uint64_t c = crc;
+        while (len >= 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            c = _mm_crc32_u64(c, v);
+            p += 8;
+            len -= 8;
+        }
+        uint32_t c32 = (uint32_t)c;
+        while (len--) c32 = _mm_crc32_u8(c32, *p++);
+        return c32;
+    }
+    inline bool has_sse42() {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#endif
+    // 이어서 계산 가능: crc32c(crc32c(0, a), b) == crc32c(0, a+b)
+    inline uint32_t crc32c(uint32_t crc, const char* data, size_t len) {
+        const unsigned char* p = (const unsigned char*)data;
+        crc = ~crc;
+#if defined(__x86_64__)
+        if (has_sse42()) return ~crc32c_hw(crc, p, len);
+#endif
+        return ~crc32c_sw(crc, p, len);
+    }
+
+    class Sha256 {
+    public:
+        Sha256() {
+            static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+            memcpy(h, init, sizeof(h));
+        }
+        void update(const char* data, size_t len) {
+            const unsigned char* p = (const unsigned char*)data;
+            total += len;
+            if (fill > 0) {
+                size_t take = std::min(len, (size_t)64 - fill);
+                memcpy(block + fill, p, take);
+                fill += take;
+                p += take;
+                len -= take;
+                if (fill < 64) return;
+                compress(block);
+                fill = 0;
+            }
+            for (; len >= 64; p += 64, len -= 64) compress(p);
+            memcpy(block, p, len);
+            fill = len;
+        }
+        std::string hex_digest() {
+            uint64_t bits = total * 8;
+            unsigned char pad = 0x80;
+            update((const char*)&pad, 1);
+            unsigned char zero = 0;
+            while (fill != 56) update((const char*)&zero, 1);
+            unsigned char len_be[8];
+            for (int i = 0; i < 8; ++i) len_be[i] = (unsigned char)(bits >> (56 - 8 * i));
+            update((const char*)len_be, 8);
+            char out[65];
+            for (int i = 0; i < 8; ++i) snprintf(out + 8 * i, 9, "%08x", h[i]);
+            return out;
+        }
+    private:
+        static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+        void compress(const unsigned char* p) {
+            static const uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+            uint32_t w[64];
+            for (int i = 0; i < 16; ++i)
+                w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+            for (int i = 16; i < 64; ++i) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+            for (int i = 0; i < 64; ++i) {
+                uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                hh = g; g = f; f = e; e = d + t1;
+                d = c; c = b; b = a; a = t1 + t2;
+            }
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+        }
+        uint32_t h[8];
+        unsigned char block[64];
+        size_t fill = 0;
+        uint64_t total = 0;
+    };
+
+    inline std::string crc_hex(uint32_t crc) {
+        char buf[9];
+        snprintf(buf, sizeof(buf), "%08x", crc);
+        return buf;
+    }
+
+    // 전송 중 청크가 지나갈 때마다 update: 파일 CRC, 1MB 블록별 CRC, (선택) SHA-256을 함께 계산
+    struct StreamChecksum {
+        uint32_t crc = 0;
+        std::vector<uint32_t> blocks;
+        std::string sha256;                 // finish() 후 채워짐 (강한 해시 미사용 시 빈 문자열)
+        bool strong = false;
+
+        explicit StreamChecksum(bool with_strong_hash = false) : strong(with_strong_hash) {}
+        void update(const char* data, size_t len) {
+            crc = crc32c(crc, data, len);
+            if (strong) sha.update(data, len);
+            while (len > 0) {
+                size_t take = std::min(len, CRC_BLOCK_SIZE - block_fill);
+                block_crc = crc32c(block_crc, data, take);
+                block_fill += take;
+                data += take;
+                len -= take;
+                if (block_fill == CRC_BLOCK_SIZE) {
+                    blocks.push_back(block_crc);
+                    block_crc = 0;
+                    block_fill = 0;
+                }
+            }
+        }
+        void finish() {
+            if (block_fill > 0) blocks.push_back(block_crc);
+            block_crc = 0;
+            block_fill = 0;
+            if (strong) sha256 = sha.hex_digest();
+        }
+        // "CRC|<파일>|<블록1>,<블록2>...|<sha256 또는 ->|\n"
+        std::string trailer() const {
+            std::string out = "CRC|" + crc_hex(crc) + "|";
+            for (size_t i = 0; i < blocks.size(); ++i) out += (i ? "," : "") + crc_hex(blocks[i]);
+            out += "|" + (sha256.empty() ? std::string("-") : sha256) + "|\n";
+            return out;
+        }
+    private:
+        Sha256 sha;
+        uint32_t block_crc = 0;
+        size_t block_fill = 0;
+    };
+
+    struct Trailer {
+        uint32_t crc = 0;
+        std::vector<uint32_t> blocks;
+        std::string sha256;                 // 없으면 빈 문자열
+    };
+    inline bool parse_trailer(const std::string& line, Trailer& out) {
+        if (line.compare(0, 4, "CRC|") != 0) return false;
+        std::istringstream iss(line.substr(4));
+        std::string crc, blocks, sha;
+        if (!getline(iss, crc, '|') || !getline(iss, blocks, '|') || !getline(iss, sha, '|')) return false;
+        out.crc = strtoul(crc.c_str(), nullptr, 16);
+        out.blocks.clear();
+        std::istringstream bss(blocks);
+        std::string b;
+        while (getline(bss, b, ',')) out.blocks.push_back(strtoul(b.c_str(), nullptr, 16));
+        out.sha256 = sha == "-" ? "" : sha;
+        return true;
+    }
+    // 검증 결과: 빈 문자열이면 일치, 아니면 원인 설명 (어느 블록이 틀렸는지)
+    inline std::string verify(const StreamChecksum& got, const Trailer& expected) {
+        std::string bad;
+        size_t n = std::max(got.blocks.size(), expected.blocks.size());
+        for (size_t i = 0; i < n; ++i) {
+            if (i < got.blocks.size() && i < expected.blocks.size() && got.blocks[i] == expected.blocks[i]) continue;
+            bad += (bad.empty() ? "" : ",") + std::to_string(i);
+        }
+        if (!bad.empty()) return "블록 " + bad + " CRC 불일치";
+        if (got.crc != expected.crc) return "파일 CRC 불일치";
+        if (!got.sha256.empty() && !expected.sha256.empty() && got.sha256 != expected.sha256) return "SHA-256 불일치";
+        return "";
+    }
+}
@@ -3,22 +3,43 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <map>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
 #include <algorithm>
+#include "checksum.h"
 
 // ---- Constants ----
 constexpr int PORT = 9001;           
 constexpr int BUFFER_SIZE = 8192;    
+const std::string CACHE_DIR = ".filechat_cache/";               // 다운로드 캐시 폴더
+constexpr long long CACHE_LIMIT = 256LL * 1024 * 1024;          // 캐시 전체 크기 한도 (LRU로 축출)
 
 // ---- Global Variables ----
 int sock = -1;                       
 std::string current_dir;             
 std::atomic<bool> running(true);     
+std::mutex sock_mutex;               // 명령 응답/파일 본문을 받는 동안 수신 스레드가 소켓을 읽지 않도록
+
+// 다운로드 캐시: 서버경로 -> 캐시 파일 및 서버 기준 크기/수정시각/CRC32C
+struct CacheEntry {
+    std::string blob;
+    long long size = 0;
+    long long mtime = 0;
+    uint32_t crc = 0;
+    long long last_used = 0;
+};
+std::map<std::string, CacheEntry> download_cache;
 
 // ---- Function Declarations ----
 void print_welcome();
@@ -26,15 +47,23 @@ void usage();
 void print_command_guide();
 void send_cmd(const std::string& cmd);
 std::string recv_resp();
+bool recv_line(std::string& line);
 std::string join_path(const std::string& dir, const std::string& path);
 std::string normalize_path(const std::string& path);
+void load_cache_index();
+void save_cache_index();
+void evict_cache();
 
 // ---- 채팅/알림 수신 스레드 ----
 void recv_thread() {
     char buf[BUFFER_SIZE];
     std::string recv_buffer;
     while (running) {
-        int len = recv(sock, buf, sizeof(buf)-1, MSG_DONTWAIT);
+        int len = -1;
+        {
+            std::unique_lock<std::mutex> lock(sock_mutex, std::try_to_lock);
+            if (lock.owns_lock()) len = recv(sock, buf, sizeof(buf)-1, MSG_DONTWAIT);
+        }
         if (len > 0) {
             recv_buffer.append(buf, len);
             size_t pos;
@@ -77,15 +106,18 @@ void usage() {
         "/mkdir <폴더>      - 새 폴더 생성\n"
         "/upload <로컬파일> [서버경로]   - 파일 업로드\n"
         "/download <서버경로> [로컬파일] - 파일 다운로드\n"
-        "/rm <서버경로>     - 파일/폴더 삭제\n"
+        "/rm <서버경로>     - 파일/폴더 삭제 (휴지통으로 이동)\n"
+        "/restore [경로|#번호] [새경로] - 휴지통 목록 보기 / 삭제한 항목 복구\n"
         "/mv <원경로> <새경로> - 파일/폴더 이름 변경/이동\n"
         "/share <경로> <상대유저>    - 파일/폴더 공유\n"
         "/unshare <경로> <상대유저>  - 공유 해제\n"
         "/sharedwithme      - 나에게 공유된 목록 보기\n"
         "/search <키워드>   - 파일/폴더명 키워드 검색\n"
+        "/du [폴더]         - 폴더 사용량 및 용량 한도 보기\n"
         "/cd <폴더명>       - 폴더 이동\n"
         "/pwd               - 현재 경로 표시\n"
         "/msg <상대유저> <메시지> - 실시간 메시지 보내기\n"
+        "/history <상대유저> [개수|YYYY-MM-DD|#번호|개수<#번호] - 지난 대화 보기\n"
         "/who               - 현재 접속 중인 유저 목록\n"
         "/quit              - 프로그램 종료\n"
         "/help, /?          - 이 도움말 다시 보기\n";
@@ -121,6 +153,21 @@ std::string recv_resp() {
     return std::string(buf, len);
 }
 
+// 다운로드 본문 뒤의 체크섬 트레일러 한 줄 수신 ('\n'까지만 꺼내 뒤따르는 채팅 알림은 남겨 둠)
+bool recv_line(std::string& line) {
+    char buf[BUFFER_SIZE];
+    while (line.find('\n') == std::string::npos) {
+        int l = recv(sock, buf, sizeof(buf), MSG_PEEK);
+        if (l <= 0) return false;
+        char* nl = (char*)memchr(buf, '\n', l);
+        int take = nl ? (int)(nl - buf) + 1 : l;
+        if (recv(sock, buf, take, 0) != take) return false;
+        line.append(buf, take);
+    }
+    line.erase(line.find('\n'));
+    return true;
+}
+
 std::string join_path(const std::string& dir, const std::string& path) {
     if (path.empty()) return dir;
     if (path[0] == '/') return path; // 절대경로
@@ -148,12 +195,72 @@ std::string normalize_path(const std::string& path) {
     return result;
 }
 
+// ---- 다운로드 캐시 ----
+
+// 캐시 파일 이름용 FNV-1a 64비트 해시 (서버경로 -> 파일명)
+uint64_t fnv1a(uint64_t h, const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string hash_hex(uint64_t h) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+// 인덱스 한 줄: <캐시파일> <크기> <수정시각> <CRC32C> <마지막사용> <서버경로>
+void load_cache_index() {
+    download_cache.clear();
+    std::ifstream ifs(CACHE_DIR + "index.txt");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        CacheEntry e;
+        std::string hex, remote;
+        if (!(iss >> e.blob >> e.size >> e.mtime >> hex >> e.last_used >> remote)) continue;
+        e.crc = strtoul(hex.c_str(), nullptr, 16);
+        download_cache[remote] = e;
+    }
+}
+
+void save_cache_index() {
+    mkdir(CACHE_DIR.c_str(), 0755);
+    std::ofstream ofs(CACHE_DIR + "index.txt");
+    for (const auto& kv : download_cache) {
+        const CacheEntry& e = kv.second;
+        ofs << e.blob << " " << e.size << " " << e.mtime << " " << checksum::crc_hex(e.crc) << " "
+            << e.last_used << " " << kv.first << "\n";
+    }
+}
+
+// 한도를 넘으면 가장 오래 안 쓴 항목부터 삭제
+void evict_cache() {
+    long long total = 0;
+    for (const auto& kv : download_cache) total += kv.second.size;
+    while (total > CACHE_LIMIT && !download_cache.empty()) {
+        auto oldest = download_cache.begin();
+        for (auto it = download_cache.begin(); it != download_cache.end(); ++it)
+            if (it->second.last_used < oldest->second.last_used) oldest = it;
+        remove((CACHE_DIR + oldest->second.blob).c_str());
+        total -= oldest->second.size;
+        download_cache.erase(oldest);
+    }
+}
+
 // ---- Main ----
-int main() {
-    print_welcome();
-    std::string serv_ip;
-    std::cout << "[서버에 접속하려면] 서버 IP를 입력하세요 (예: 127.0.0.1): ";
-    std::cin >> serv_ip;
+// "IP" 또는 "IP:포트" 로 접속하고 환영 메시지를 받음. 실패 시 0이 아닌 값 반환
+int connect_server(const std::string& addr) {
+    std::string serv_ip = addr;
+    int port = PORT;
+    size_t colon = addr.find(':');
+    if (colon != std::string::npos) {
+        serv_ip = addr.substr(0, colon);
+        port = atoi(addr.c_str() + colon + 1);
+    }
 
     // 소켓 생성
     sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -164,7 +271,7 @@ int main() {
     // 서버 주소 설정
     sockaddr_in serv_addr{};
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(port);
     if (inet_pton(AF_INET, serv_ip.c_str(), &serv_addr.sin_addr) <= 0) {
         std::cerr << "IP 변환 실패 (입력값 확인)\n";
         return 1;
@@ -179,6 +286,15 @@ int main() {
     // 서버 환영 메시지 수신
     std::string welcome = recv_resp();
     std::cout << welcome;
+    return 0;
+}
+
+int main() {
+    print_welcome();
+    std::string serv_ip;
+    std::cout << "[서버에 접속하려면] 서버 IP를 입력하세요 (예: 127.0.0.1, 포트 지정 시 127.0.0.1:9002): ";
+    std::cin >> serv_ip;
+    if (int err = connect_server(serv_ip)) return err;
 
     // ---- 로그인/회원가입 루프 ----
     bool logged_in = false;
@@ -194,10 +310,20 @@ int main() {
         oss << mode << "|" << id << "|" << pw << "|\n";
         send_cmd(oss.str());
         std::string resp = recv_resp();
+        // 클러스터: 이 아이디의 담당 서버로 다시 접속해서 같은 요청을 보냄
+        if (resp.find("ERR|REDIRECT|") == 0) {
+            std::string target = resp.substr(13, resp.find('|', 13) - 13);
+            std::cout << "[안내] 담당 서버(" << target << ")로 다시 접속합니다.\n";
+            close(sock);
+            if (int err = connect_server(target)) return err;
+            send_cmd(oss.str());
+            resp = recv_resp();
+        }
         std::cout << resp;
         if (resp.find("OK|") == 0) logged_in = true;
     }
 
+    load_cache_index();
     usage(); // 명령어 도움말 출력
     print_command_guide();
 
@@ -215,6 +341,7 @@ int main() {
         std::istringstream iss(line);
         std::string cmd, arg1, arg2;
         iss >> cmd >> arg1 >> arg2;
+        std::lock_guard<std::mutex> io_lock(sock_mutex);
 
         // 명령어 파싱 및 처리
         if (cmd == "/pwd") {
@@ -228,10 +355,10 @@ int main() {
             std::string new_dir = join_path(current_dir, arg1);
             new_dir = normalize_path(new_dir);
             std::ostringstream oss;
-            oss << "/ls|" << new_dir << "|\n";
+            oss << "/stat|" << new_dir << "|\n";
             send_cmd(oss.str());
             std::string resp = recv_resp();
-            if (resp.find("OK|") == 0 && resp.find("(폴더 없음)") == std::string::npos) {
+            if (resp.find("OK|DIR|") == 0) {
                 current_dir = new_dir;
             } else {
                 std::cout << "[안내] 폴더가 존재하지 않습니다.\n";
@@ -261,6 +388,14 @@ int main() {
             send_cmd(oss.str());
             std::cout << recv_resp();
         }
+        else if (cmd == "/restore") {
+            // 인자 없으면 휴지통 목록, "#번호"는 그대로, 경로는 현재 폴더 기준으로 변환
+            std::string key = arg1, to;
+            if (!key.empty() && key[0] != '#') key = normalize_path(join_path(current_dir, key));
+            if (!arg2.empty()) to = normalize_path(join_path(current_dir, arg2));
+            send_cmd("/restore|" + key + "|" + to + "|\n");
+            std::cout << recv_resp();
+        }
         else if (cmd == "/mv") {
             std::string from = join_path(current_dir, arg1);
             from = normalize_path(from);
@@ -297,6 +432,14 @@ int main() {
             send_cmd(oss.str());
             std::cout << recv_resp();
         }
+        else if (cmd == "/du") {
+            std::string path = arg1.empty() ? current_dir : join_path(current_dir, arg1);
+            path = normalize_path(path);
+            std::ostringstream oss;
+            oss << "/du|" << path << "|\n";
+            send_cmd(oss.str());
+            std::cout << recv_resp();
+        }
         else if (cmd == "/upload") {
             if (arg1.empty()) {
                 std::cout << "[안내] 업로드할 파일명을 입력하세요.\n";
@@ -314,14 +457,23 @@ int main() {
             std::ostringstream oss;
             oss << "/upload|" << remote << "|" << filesize << "|\n";
             send_cmd(oss.str());
+            // 서버가 용량 한도를 확인한 뒤 READY를 보내야 전송 시작
+            std::string ready = recv_resp();
+            if (ready.find("OK|READY") != 0) {
+                std::cout << ready;
+                continue;
+            }
             char buf[BUFFER_SIZE];
             int sent = 0;
+            // 보내면서 CRC32C/SHA-256을 계산해 본문 뒤 트레일러로 전송 (서버가 블록 단위로 검증)
+            checksum::StreamChecksum sum(true);
             std::cout << "[안내] 업로드 시작 (" << filesize << " 바이트)..." << std::endl;
             while (sent < filesize) {
                 int tosend = std::min(BUFFER_SIZE, filesize - sent);
                 ifs.read(buf, tosend);
                 int l = send(sock, buf, tosend, 0);
                 if (l <= 0) break;
+                sum.update(buf, l);
                 sent += l;
                 int percent = (int)(100.0 * sent / filesize);
                 if (percent % 10 == 0)
@@ -332,6 +484,9 @@ int main() {
             // === 전송 바이트 검증 추가 ===
             if (sent != filesize) {
                 std::cout << "\n[경고] 파일 전송 바이트 불일치 (전송:" << sent << ", 기대:" << filesize << ")\n";
+            } else {
+                sum.finish();
+                send_cmd(sum.trailer());
             }
             std::cout << recv_resp();
         }
@@ -343,24 +498,60 @@ int main() {
             std::string remote = join_path(current_dir, arg1);
             remote = normalize_path(remote);
             std::string local = arg2.empty() ? arg1 : arg2;
+            // 캐시에 있으면 크기:수정시각:CRC32C를 함께 보내 변경이 없을 때 본문 전송 생략
+            auto cached = download_cache.find(remote);
+            struct stat cst;
+            if (cached != download_cache.end() && stat((CACHE_DIR + cached->second.blob).c_str(), &cst) != 0)
+                cached = download_cache.end();
             std::ostringstream oss;
-            oss << "/download|" << remote << "|\n";
+            oss << "/download|" << remote << "|";
+            if (cached != download_cache.end())
+                oss << cached->second.size << ":" << cached->second.mtime << ":" << checksum::crc_hex(cached->second.crc);
+            oss << "|\n";
             send_cmd(oss.str());
             std::string resp = recv_resp();
+            if (resp.find("OK|NOTMOD|") == 0 && cached != download_cache.end()) {
+                std::ifstream cifs(CACHE_DIR + cached->second.blob, std::ios::binary);
+                std::ofstream ofs(local, std::ios::binary);
+                ofs << cifs.rdbuf();
+                cached->second.last_used = time(nullptr);
+                save_cache_index();
+                std::cout << "[안내] 서버 파일 변경 없음, 캐시에서 복사: " << local << std::endl;
+                continue;
+            }
             if (resp.substr(0, 3) != "OK|") {
                 std::cout << resp;
                 continue;
             }
             size_t p1 = resp.find('|', 3);
+            size_t p2 = resp.find('|', p1 + 1);
             int filesize = std::stoi(resp.substr(3, p1 - 3));
-            size_t file_start = p1 + 1;
-            std::ofstream ofs(local, std::ios::binary);
+            long long mtime = std::stoll(resp.substr(p1 + 1, p2 - p1 - 1));
+            size_t file_start = p2 + 1;
+            // 검증이 끝나기 전에는 local.part에 받고, 통과하면 local로 rename (손상된 파일을 남기지 않음)
+            std::string tmp_local = local + ".part";
+            std::ofstream ofs(tmp_local, std::ios::binary);
+            // 한도 이하 파일은 받는 동안 캐시에도 기록
+            std::string blob = hash_hex(fnv1a(1469598103934665603ULL, remote.data(), remote.size())) + ".bin";
+            std::string tmp_blob = CACHE_DIR + blob + ".part";
+            bool to_cache = filesize <= CACHE_LIMIT;
+            std::ofstream cofs;
+            if (to_cache) {
+                mkdir(CACHE_DIR.c_str(), 0755);
+                cofs.open(tmp_blob, std::ios::binary);
+                to_cache = (bool)cofs;
+            }
+            checksum::StreamChecksum sum(true);
             int recvd = 0;
-            // 응답 메시지에 파일 일부가 포함되어 있는 경우 처리
+            std::string trailer;
+            // 응답 메시지에 파일 일부(작은 파일이면 트레일러까지)가 포함되어 있는 경우 처리
             if (resp.size() > file_start) {
-                int remain = resp.size() - file_start;
+                int remain = std::min<long long>(resp.size() - file_start, filesize);
                 ofs.write(resp.data() + file_start, remain);
+                if (to_cache) cofs.write(resp.data() + file_start, remain);
+                sum.update(resp.data() + file_start, remain);
                 recvd += remain;
+                trailer = resp.substr(file_start + remain);
             }
             char buf[BUFFER_SIZE];
             while (recvd < filesize) {
@@ -368,14 +559,49 @@ int main() {
                 int l = recv(sock, buf, toread, 0);
                 if (l <= 0) break;
                 ofs.write(buf, l);
+                if (to_cache) cofs.write(buf, l);
+                sum.update(buf, l);
                 recvd += l;
             }
             ofs.close();
-            if (recvd == filesize)
-                std::cout << "\r[안내] 다운로드 완료: " << local << "           " << std::endl;
+            sum.finish();
+            // 서버가 보낸 트레일러와 블록별 CRC/파일 CRC(/SHA-256) 비교
+            std::string integrity_error;
+            checksum::Trailer expected;
+            if (recvd == filesize) {
+                if (!recv_line(trailer) || !checksum::parse_trailer(trailer, expected))
+                    integrity_error = "체크섬 트레일러 없음";
+                else
+                    integrity_error = checksum::verify(sum, expected);
+            }
+            bool ok = recvd == filesize && integrity_error.empty();
+            bool saved = ok && rename(tmp_local.c_str(), local.c_str()) == 0;
+            if (!saved) remove(tmp_local.c_str());
+            if (to_cache) {
+                cofs.close();
+                if (ok && rename(tmp_blob.c_str(), (CACHE_DIR + blob).c_str()) == 0) {
+                    CacheEntry& e = download_cache[remote];
+                    e.blob = blob;
+                    e.size = filesize;
+                    e.mtime = mtime;
+                    e.crc = sum.crc;
+                    e.last_used = time(nullptr);
+                    evict_cache();
+                    save_cache_index();
+                } else {
+                    remove(tmp_blob.c_str());
+                }
+            }
+            if (saved)
+                std::cout << "\r[안내] 다운로드 완료: " << local << " (crc32c " << checksum::crc_hex(sum.crc) << ")" << std::endl;
+            else if (ok)
+                std::cout << "\r[경고] 다운로드 실패: " << local << " 저장 실패 (" << strerror(errno) << ")" << std::endl;
             else {
                 std::cout << "\r[경고] 다운로드 실패: " << local << "           " << std::endl;
-                std::cout << "\n[경고] 파일 수신 바이트 불일치 (수신:" << recvd << ", 기대:" << filesize << ")\n";
+                if (recvd != filesize)
+                    std::cout << "\n[경고] 파일 수신 바이트 불일치 (수신:" << recvd << ", 기대:" << filesize << ")\n";
+                else
+                    std::cout << "\n[경고] 무결성 검증 실패: " << integrity_error << " - 다시 받아 주세요\n";
             }
         }
         else if (cmd == "/msg") {
@@ -393,6 +619,16 @@ int main() {
             send_cmd(oss.str());
             std::cout << recv_resp();
         }
+        else if (cmd == "/history") {
+            if (arg1.empty()) {
+                std::cout << "[안내] 대화 상대 유저명을 입력하세요.\n";
+                continue;
+            }
+            std::ostringstream oss;
+            oss << "/history|" << arg1 << "|" << arg2 << "|\n";
+            send_cmd(oss.str());
+            std::cout << recv_resp();
+        }
         else if (cmd == "/who") {
             send_cmd("/who||\n");
             std::cout << recv_resp();
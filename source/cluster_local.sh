@@ -0,0 +1,35 @@
+#!/bin/bash
+# 한 컴퓨터에서 루프백 포트로 클러스터를 띄우는 테스트용 스크립트
+# 사용법: ./cluster_local.sh [노드 수(기본 3)] [시작 포트(기본 9001)]
+#   - 노드 k 는 포트 (시작+k-1), 내부 링크 포트 (+1000), 작업 폴더 cluster_data/node<k>
+#   - 클라이언트는 아무 노드에나 접속하면 담당 노드로 자동 재접속됩니다 (예: 127.0.0.1:9002)
+#   - Ctrl+C 로 모든 노드 종료
+set -e
+cd "$(dirname "$0")"
+
+COUNT=${1:-3}
+BASE_PORT=${2:-9001}
+
+if [ ! -x ./server ]; then
+    g++ server_FileChat.cpp -o server -pthread
+fi
+
+# 같은 컴퓨터의 노드는 주소(127.0.0.1)로 구분되지 않으므로 내부 요청은 실행마다 새로 만든 비밀로 서명
+SECRET=$(head -c 16 /dev/urandom | od -An -tx1 | tr -d ' \n')
+
+PEERS=""
+for k in $(seq 1 "$COUNT"); do
+    PEERS="${PEERS:+$PEERS,}node$k=127.0.0.1:$((BASE_PORT + k - 1))"
+done
+
+PIDS=()
+trap 'kill "${PIDS[@]}" 2>/dev/null; exit 0' INT TERM
+for k in $(seq 1 "$COUNT"); do
+    mkdir -p "cluster_data/node$k"
+    ./server --node "node$k" --peers "$PEERS" --cluster-secret "$SECRET" --workdir "cluster_data/node$k" \
+        < /dev/null > "cluster_data/node$k.log" 2>&1 &
+    PIDS+=($!)
+    echo "[안내] node$k 시작: 포트 $((BASE_PORT + k - 1)), 로그 cluster_data/node$k.log"
+done
+
+wait
@@ -3,13 +3,37 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <tuple>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <string_view>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
 #include <dirent.h>
 #include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <ctime>
+#include "checksum.h"
 
 // ---- 전역 상수 정의 ----
 constexpr int PORT = 9001;
@@ -17,16 +41,366 @@ constexpr int BUFFER_SIZE = 8192;
 const std::string DATA_ROOT = "server_data/users/";
 const std::string USER_DB_FILE = DATA_ROOT + ".userdb";
 const std::string SHARE_MAP_FILE = "server_data/sharemap.txt";
+const std::string USAGE_DIR = "server_data/usage/";
+const std::string QUOTA_FILE = "server_data/quota.txt";
+constexpr long long DEFAULT_QUOTA = 1LL << 30;      // 유저별 기본 용량 한도 (1GB)
+constexpr int USAGE_SCAN_INTERVAL_SEC = 300;        // 백그라운드 사용량 재계산 주기
 
 // ---- 동시성 제어용 mutex ----
 std::mutex user_mutex;
 std::mutex share_mutex;
 std::mutex conn_mutex;
+std::mutex usage_mutex;
+std::mutex meta_mutex;
 
 // ---- 서버 상태를 저장하는 주요 자료구조 ----
 std::map<std::string, std::string> user_db;
 std::multimap<std::string, std::pair<std::string, std::string>> share_map;
 std::map<std::string, int> user_conn;
+// 유저별 폴더 사용량: 상대경로("" = 홈 루트) -> 하위 파일 바이트 합계
+std::map<std::string, std::map<std::string, long long>> usage_db;
+std::map<std::string, long long> quota_db;
+std::set<std::string> usage_dirty;
+std::map<std::string, unsigned long long> usage_gen;   // 유저별 사용량 변경 세대 (재계산 중 변경 감지용)
+
+// ---- io_uring 비동기 I/O 백엔드 (선택) ----
+// 업로드/다운로드 전송과 폴더 작업을 io_uring으로 처리한다. 커널이 지원하지 않거나 --no-uring이면 기존 경로 사용.
+// 다운로드: 등록된 버퍼에 READ_FIXED → SEND 를 링크로 묶어 여러 청크를 시스템콜 한 번에 제출한다.
+// 업로드: 직전 청크의 WRITE_FIXED와 다음 청크 RECV를 함께 제출한다.
+// 클라이언트 스레드마다 링 하나(thread_local)를 쓴다.
+namespace uring {
+    constexpr unsigned QUEUE_DEPTH = 32;
+    constexpr int NUM_BUFFERS = 4;
+    constexpr size_t CHUNK_SIZE = 64 * 1024;     // 등록 버퍼 1개 크기
+    bool available = false;
+    thread_local long long enter_calls = 0;      // io_uring_enter 호출 수 (벤치마크용)
+
+    class Ring {
+    public:
+        ~Ring() {
+            // 완료를 다 거두지 못한 요청이 있으면 커널이 아직 버퍼에 쓸 수 있으므로 버퍼는 해제하지 않고 둔다
+            if (buffers && inflight == 0) free(buffers);
+            if (sqes) munmap(sqes, sqes_len);
+            if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+            if (sq_ptr) munmap(sq_ptr, sq_len);
+            if (fd >= 0) close(fd);
+        }
+        bool init() {
+            io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            fd = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &p);
+            if (fd < 0) return false;
+            sq_entries = p.sq_entries;
+            sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap) sq_len = cq_len = std::max(sq_len, cq_len);
+            sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; return false; }
+            cq_ptr = single_mmap ? sq_ptr : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) { cq_ptr = nullptr; return false; }
+            sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+            void* s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (s == MAP_FAILED) return false;
+            sqes = (io_uring_sqe*)s;
+            char* sq = (char*)sq_ptr;
+            char* cq = (char*)cq_ptr;
+            sq_head = (unsigned*)(sq + p.sq_off.head);
+            sq_tail = (unsigned*)(sq + p.sq_off.tail);
+            sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+            sq_array = (unsigned*)(sq + p.sq_off.array);
+            cq_head = (unsigned*)(cq + p.cq_off.head);
+            cq_tail = (unsigned*)(cq + p.cq_off.tail);
+            cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+            local_tail = *sq_tail;
+            // 전송용 버퍼를 커널에 미리 등록 (매 요청마다 페이지 고정 비용 제거)
+            buffers = (char*)aligned_alloc(4096, NUM_BUFFERS * CHUNK_SIZE);
+            if (!buffers) return false;
+            iovec iov[NUM_BUFFERS];
+            for (int i = 0; i < NUM_BUFFERS; ++i) {
+                iov[i].iov_base = buffers + i * CHUNK_SIZE;
+                iov[i].iov_len = CHUNK_SIZE;
+            }
+            return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, NUM_BUFFERS) == 0;
+        }
+        // 지원하지 않는 opcode가 있으면 false
+        bool supports(const std::vector<int>& ops) {
+            size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+            std::vector<char> mem(len, 0);
+            io_uring_probe* probe = (io_uring_probe*)mem.data();
+            if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+            for (int op : ops)
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+            return true;
+        }
+        char* buffer(int i) { return buffers + i * CHUNK_SIZE; }
+        io_uring_sqe* next_sqe(int opcode, int target_fd, uint64_t user_data) {
+            if (local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) return nullptr;
+            unsigned idx = local_tail & sq_mask;
+            io_uring_sqe* sqe = &sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = opcode;
+            sqe->fd = target_fd;
+            sqe->user_data = user_data;
+            sq_array[idx] = idx;
+            ++local_tail;
+            ++queued;
+            return sqe;
+        }
+        // 쌓인 SQE를 제출하고 count개 완료를 out에 받는다 (user_data 순서가 아닌 완료 순서)
+        // io_uring_enter가 실패하면 broken()이 되고, 이미 제출된 요청은 커널에서 진행 중일 수 있으므로
+        // 호출자는 전송을 이어가지 말고 연결을 끊은 뒤 discard()로 링을 버려야 한다.
+        bool submit_and_wait(unsigned count, std::vector<io_uring_cqe>& out) {
+            out.clear();
+            if (failed) return false;
+            __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+            unsigned to_submit = queued;
+            queued = 0;
+            while (out.size() < count) {
+                unsigned head = *cq_head;
+                unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail && out.size() < count; ++head) out.push_back(cqes[head & cq_mask]);
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                if (out.size() >= count && to_submit == 0) break;
+                unsigned want = count - out.size();
+                int ret = syscall(__NR_io_uring_enter, fd, to_submit, want, want ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                ++enter_calls;
+                if (ret < 0 && errno != EINTR) {
+                    failed = true;
+                    inflight += count - (to_submit + out.size());   // 제출됐지만 완료를 못 거둔 요청
+                    return false;
+                }
+                if (ret > 0) to_submit -= std::min<unsigned>(to_submit, ret);
+            }
+            return true;
+        }
+        bool broken() const { return failed; }
+        // 실패 후 남은 완료를 거둠 (소켓을 먼저 끊어 두면 전송 요청도 곧바로 끝난다). 다 거두면 true
+        bool drain() {
+            for (int tries = 0; inflight > 0 && tries < 100; ++tries) {
+                unsigned head = *cq_head;
+                unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail && inflight > 0; ++head) --inflight;
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                if (inflight == 0) break;
+                if (syscall(__NR_io_uring_enter, fd, 0, inflight, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return inflight == 0;
+        }
+        // file_fd의 [0, size)를 sock으로 전송. 순서대로 전송이 확인된 바이트 수 반환 (중간 실패 시 호출자가 이어서 보냄)
+        long long send_file(int sock, int file_fd, long long size,
+                            const std::function<void(size_t)>& before_chunk,
+                            const std::function<void(const char*, size_t)>& after_chunk) {
+            long long done = 0;
+            std::vector<io_uring_cqe> cqes_out;
+            while (done < size) {
+                int n = 0;
+                size_t lens[NUM_BUFFERS];
+                for (; n < NUM_BUFFERS && done + (long long)(n * CHUNK_SIZE) < size; ++n) {
+                    lens[n] = std::min<long long>(CHUNK_SIZE, size - done - n * CHUNK_SIZE);
+                    before_chunk(lens[n]);
+                    io_uring_sqe* rd = next_sqe(IORING_OP_READ_FIXED, file_fd, 2 * n);
+                    rd->addr = (uint64_t)buffer(n);
+                    rd->len = lens[n];
+                    rd->off = done + n * CHUNK_SIZE;
+                    rd->buf_index = n;
+                    rd->flags = IOSQE_IO_LINK;
+                    io_uring_sqe* sd = next_sqe(IORING_OP_SEND, sock, 2 * n + 1);
+                    sd->addr = (uint64_t)buffer(n);
+                    sd->len = lens[n];
+                    sd->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+                    sd->flags = IOSQE_IO_LINK;    // 소켓에는 청크 순서대로 나가야 하므로 배치 전체를 한 체인으로
+                }
+                sqes[(local_tail - 1) & sq_mask].flags = 0;
+                if (!submit_and_wait(2 * n, cqes_out)) return done;
+                int results[2 * NUM_BUFFERS];
+                for (const auto& c : cqes_out) results[c.user_data] = c.res;
+                for (int i = 0; i < n; ++i) {
+                    int rd = results[2 * i], sd = results[2 * i + 1];
+                    if (rd != (int)lens[i]) return done;
+                    if (sd > 0) {
+                        after_chunk(buffer(i), sd);
+                        done += sd;
+                    }
+                    if (sd != (int)lens[i]) return done;
+                }
+            }
+            return done;
+        }
+        // 메모리 버퍼(인기 파일 캐시)를 sock으로 전송: SEND만 체인으로 묶어 제출
+        long long send_buffer(int sock, const char* data, long long size,
+                              const std::function<void(size_t)>& before_chunk,
+                              const std::function<void(const char*, size_t)>& after_chunk) {
+            long long done = 0;
+            std::vector<io_uring_cqe> cqes_out;
+            while (done < size) {
+                int n = 0;
+                size_t lens[NUM_BUFFERS];
+                for (; n < NUM_BUFFERS && done + (long long)(n * CHUNK_SIZE) < size; ++n) {
+                    lens[n] = std::min<long long>(CHUNK_SIZE, size - done - n * CHUNK_SIZE);
+                    before_chunk(lens[n]);
+                    io_uring_sqe* sd = next_sqe(IORING_OP_SEND, sock, n);
+                    sd->addr = (uint64_t)(data + done + n * CHUNK_SIZE);
+                    sd->len = lens[n];
+                    sd->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+                    sd->flags = n + 1 < NUM_BUFFERS ? IOSQE_IO_LINK : 0;
+                }
+                sqes[(local_tail - 1) & sq_mask].flags = 0;
+                if (!submit_and_wait(n, cqes_out)) return done;
+                int results[NUM_BUFFERS];
+                for (const auto& c : cqes_out) results[c.user_data] = c.res;
+                for (int i = 0; i < n; ++i) {
+                    int sd = results[i];
+                    if (sd > 0) {
+                        after_chunk(data + done, sd);
+                        done += sd;
+                    }
+                    if (sd != (int)lens[i]) return done;
+                }
+            }
+            return done;
+        }
+        // sock에서 size 바이트를 받아 file_fd에 기록. 받은 바이트 수 반환, 쓰기 실패 시 write_ok = false
+        // 버퍼를 두 묶음으로 나눠, 한 묶음에 RECV 체인을 받는 동안 다른 묶음의 WRITE_FIXED를 함께 제출한다.
+        // after_chunk는 받은 순서대로 호출된다 (버퍼가 다음 RECV에 재사용되기 전)
+        long long recv_file(int sock, int file_fd, long long size, bool& write_ok,
+                            const std::function<void(const char*, size_t)>& after_chunk) {
+            constexpr int HALF = NUM_BUFFERS / 2;
+            write_ok = true;
+            long long received = 0, written = 0;
+            std::vector<io_uring_cqe> cqes_out;
+            int cur = 0;                          // 이번에 받을 묶음 (0 또는 1)
+            int pending[HALF] = {};               // 직전에 받고 아직 기록하지 않은 바이트 (묶음 1 - cur)
+            bool eof = false;
+            while (true) {
+                unsigned count = 0;
+                long long off = written;
+                for (int i = 0; i < HALF && pending[i] > 0; ++i) {
+                    int idx = (1 - cur) * HALF + i;
+                    io_uring_sqe* wr = next_sqe(IORING_OP_WRITE_FIXED, file_fd, i);
+                    wr->addr = (uint64_t)buffer(idx);
+                    wr->len = pending[i];
+                    wr->off = off;
+                    wr->buf_index = idx;
+                    off += pending[i];
+                    ++count;
+                }
+                size_t want[HALF] = {};
+                int recvs = 0;
+                for (long long left = size - received; !eof && recvs < HALF && left > 0; ++recvs) {
+                    want[recvs] = std::min<long long>(CHUNK_SIZE, left);
+                    left -= want[recvs];
+                    io_uring_sqe* rv = next_sqe(IORING_OP_RECV, sock, HALF + recvs);
+                    rv->addr = (uint64_t)buffer(cur * HALF + recvs);
+                    rv->len = want[recvs];
+                    rv->msg_flags = MSG_WAITALL;
+                    rv->flags = IOSQE_IO_LINK;    // 짧게 받으면(연결 종료) 뒤 RECV는 취소됨
+                    ++count;
+                }
+                if (recvs > 0) sqes[(local_tail - 1) & sq_mask].flags = 0;
+                if (count == 0) break;
+                if (!submit_and_wait(count, cqes_out)) return received;
+                int results[2 * HALF];
+                for (const auto& c : cqes_out) results[c.user_data] = c.res;
+                for (int i = 0; i < HALF && pending[i] > 0; ++i) {
+                    if (results[i] != pending[i]) write_ok = false;
+                    else written += pending[i];
+                }
+                if (!write_ok) return received;
+                for (int i = 0; i < HALF; ++i) {
+                    int got = i < recvs ? results[HALF + i] : 0;
+                    pending[i] = eof ? 0 : std::max(got, 0);
+                    if (pending[i] > 0) after_chunk(buffer(cur * HALF + i), pending[i]);
+                    received += pending[i];
+                    if (i < recvs && got != (int)want[i]) eof = true;
+                }
+                cur = 1 - cur;
+            }
+            return received;
+        }
+        // 단일 경로 작업(mkdirat/renameat/unlinkat) 여러 개를 한 번에 제출하고 각 결과(res)를 반환
+        std::vector<int> run_path_ops(const std::vector<std::tuple<int, std::string, std::string, int>>& ops) {
+            std::vector<int> results(ops.size(), -EIO);
+            std::vector<io_uring_cqe> cqes_out;
+            for (size_t start = 0; start < ops.size(); start += QUEUE_DEPTH) {
+                size_t end = std::min<size_t>(ops.size(), start + QUEUE_DEPTH);
+                for (size_t i = start; i < end; ++i) {
+                    int op = std::get<0>(ops[i]);
+                    io_uring_sqe* sqe = next_sqe(op, AT_FDCWD, i);
+                    sqe->addr = (uint64_t)std::get<1>(ops[i]).c_str();
+                    if (op == IORING_OP_MKDIRAT) {
+                        sqe->len = std::get<3>(ops[i]);
+                    } else if (op == IORING_OP_RENAMEAT) {
+                        sqe->len = AT_FDCWD;
+                        sqe->addr2 = (uint64_t)std::get<2>(ops[i]).c_str();
+                    } else {
+                        sqe->unlink_flags = std::get<3>(ops[i]);
+                    }
+                }
+                if (!submit_and_wait(end - start, cqes_out)) return results;
+                for (const auto& c : cqes_out)
+                    if (c.user_data < results.size()) results[c.user_data] = c.res;
+            }
+            return results;
+        }
+    private:
+        int fd = -1;
+        void* sq_ptr = nullptr;
+        void* cq_ptr = nullptr;
+        size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr;
+        unsigned sq_mask = 0, cq_mask = 0, sq_entries = 0;
+        unsigned local_tail = 0, queued = 0;
+        unsigned inflight = 0;                  // 실패로 완료를 거두지 못한 요청 수
+        bool failed = false;
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        char* buffers = nullptr;
+    };
+
+    thread_local std::unique_ptr<Ring> tl_ring;
+    thread_local bool tl_failed = false;
+
+    // 오류 난 링을 버리고 이 스레드는 이후 기존 I/O 경로를 사용. sock을 주면 먼저 끊어 진행 중인 전송을 끝낸다
+    void discard(int sock = -1) {
+        if (!tl_ring) return;
+        if (sock >= 0) shutdown(sock, SHUT_RDWR);
+        if (!tl_ring->drain()) std::cerr << "[경고] io_uring 남은 요청을 거두지 못함: 링 버퍼는 해제하지 않음\n";
+        tl_ring.reset();
+        tl_failed = true;
+        std::cerr << "[경고] io_uring 오류: 이 연결은 이후 기존 I/O 경로 사용\n";
+    }
+    // 현재 스레드의 링 (백엔드 비활성/생성 실패 시 nullptr → 기존 경로 사용)
+    Ring* ring() {
+        if (tl_ring && tl_ring->broken()) discard();
+        if (!available || tl_failed) return nullptr;
+        if (!tl_ring) {
+            tl_ring.reset(new Ring());
+            if (!tl_ring->init()) {
+                tl_ring.reset();
+                tl_failed = true;
+                return nullptr;
+            }
+        }
+        return tl_ring.get();
+    }
+    // 시작 시 1회: 링 생성과 필요한 opcode 지원 여부 확인
+    void init(bool allowed) {
+        if (!allowed) {
+            std::cout << "[안내] io_uring 비활성화 (--no-uring): 기존 I/O 경로 사용\n";
+            return;
+        }
+        Ring probe;
+        available = probe.init() && probe.supports({IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_SEND,
+                                                     IORING_OP_RECV, IORING_OP_MKDIRAT, IORING_OP_RENAMEAT, IORING_OP_UNLINKAT});
+        std::cout << (available ? "[안내] io_uring 전송 백엔드 사용\n" : "[안내] io_uring 사용 불가: 기존 I/O 경로 사용\n");
+    }
+}
+
+namespace shares { void rebuild_index(); }
 
 // ---- 파일/디렉토리, 유저DB, 공유DB 등 유틸리티 함수 ----
 namespace util {
@@ -57,6 +431,7 @@ namespace util {
         std::ofstream ofs(USER_DB_FILE);
         for (const auto& kv : user_db) ofs << kv.first << " " << kv.second << "\n";
     }
+    // 서버 시작 때 1회만 호출 (이후 변경은 share_map과 shares::reindex로 메모리에서 반영)
     void load_share_map() {
         share_map.clear();
         std::ifstream ifs(SHARE_MAP_FILE);
@@ -67,47 +442,58 @@ namespace util {
             if (iss >> to_user >> from_user >> path)
                 share_map.insert({to_user, {from_user, path}});
         }
+        shares::rebuild_index();
     }
     void save_share_map() {
         std::ofstream ofs(SHARE_MAP_FILE);
         for (const auto& kv : share_map)
             ofs << kv.first << " " << kv.second.first << " " << kv.second.second << "\n";
     }
-    std::string list_dir(const std::string& path) {
-        std::ostringstream oss;
-        DIR* dp = opendir(path.c_str());
-        if (!dp) return "(폴더 없음)\n";
-        struct dirent* ep;
-        while ((ep = readdir(dp)) != nullptr) {
-            if (strcmp(ep->d_name, ".") == 0 || strcmp(ep->d_name, "..") == 0) continue;
-            std::string fullpath = path + "/" + ep->d_name;
-            struct stat st;
-            stat(fullpath.c_str(), &st);
-            oss << (S_ISDIR(st.st_mode) ? "[DIR] " : "[FILE] ") << ep->d_name << "\n";
-        }
-        closedir(dp);
-        return oss.str();
-    }
     bool make_dir(const std::string& path) {
         struct stat st;
         if (stat(path.c_str(), &st) == 0) return false;
+        if (uring::Ring* r = uring::ring())
+            return r->run_path_ops({std::make_tuple((int)IORING_OP_MKDIRAT, path, std::string(), 0755)})[0] == 0;
         return mkdir(path.c_str(), 0755) == 0;
     }
-    bool remove_path(const std::string& path) {
+    // pace가 있으면 unlink 묶음(최대 PACE_BATCH개)마다 처리한 개수로 호출 (휴지통 비우기 속도 조절용)
+    constexpr size_t PACE_BATCH = 256;
+    bool remove_path(const std::string& path, const std::function<void(size_t)>& pace = nullptr) {
         struct stat st;
         if (stat(path.c_str(), &st) != 0) return false;
         if (S_ISDIR(st.st_mode)) {
             DIR* dir = opendir(path.c_str());
             if (!dir) return false;
+            std::vector<std::string> files;
             struct dirent* entry;
             while ((entry = readdir(dir)) != nullptr) {
                 if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
                 std::string child = path + "/" + entry->d_name;
-                remove_path(child);
+                struct stat cst;
+                bool is_dir = entry->d_type == DT_DIR ||
+                    (entry->d_type == DT_UNKNOWN && stat(child.c_str(), &cst) == 0 && S_ISDIR(cst.st_mode));
+                if (is_dir) remove_path(child, pace);
+                else files.push_back(child);
             }
             closedir(dir);
+            uring::Ring* r = uring::ring();
+            for (size_t start = 0; start < files.size(); start += PACE_BATCH) {
+                size_t end = std::min(files.size(), start + PACE_BATCH);
+                if (r) {
+                    // 폴더 안 파일들의 unlink를 묶어서 제출
+                    std::vector<std::tuple<int, std::string, std::string, int>> ops;
+                    for (size_t i = start; i < end; ++i) ops.emplace_back(IORING_OP_UNLINKAT, files[i], std::string(), 0);
+                    r->run_path_ops(ops);
+                } else {
+                    for (size_t i = start; i < end; ++i) remove(files[i].c_str());
+                }
+                if (pace) pace(end - start);
+            }
+            if (pace) pace(1);
+            if (r) return r->run_path_ops({std::make_tuple((int)IORING_OP_UNLINKAT, path, std::string(), (int)AT_REMOVEDIR)})[0] == 0;
             return rmdir(path.c_str()) == 0;
         } else {
+            if (pace) pace(1);
             return remove(path.c_str()) == 0;
         }
     }
@@ -116,376 +502,2899 @@ namespace util {
         if (slash != std::string::npos) {
             ensure_dir(to.substr(0, slash));
         }
-        return rename(from.c_str(), to.c_str()) == 0;
-    }
-    void search_recursive(
-        const std::string& base,
-        const std::string& path,
-        const std::string& keyword,
-        std::vector<std::string>& results
-    ) {
-        std::string fullpath = base + (path.empty() ? "" : "/" + path);
-        DIR* dir = opendir(fullpath.c_str());
-        if (!dir) return;
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            std::string rel = path.empty() ? entry->d_name : path + "/" + entry->d_name;
-            if (strstr(entry->d_name, keyword.c_str()))
-                results.push_back(rel);
-            std::string child_full = fullpath + "/" + entry->d_name;
-            struct stat st;
-            if (stat(child_full.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
-                search_recursive(base, rel, keyword, results);
+        if (uring::Ring* r = uring::ring()) {
+            int res = r->run_path_ops({std::make_tuple((int)IORING_OP_RENAMEAT, from, to, 0)})[0];
+            if (res < 0) errno = -res;                  // 호출자가 strerror(errno)로 원인을 보여줄 수 있게
+            return res == 0;
         }
-        closedir(dir);
+        return rename(from.c_str(), to.c_str()) == 0;
     }
 }
 
-// ---- 클라이언트와의 통신 및 명령 핸들러 ----
-void send_response(int client_sock, const std::string& msg) {
-    send(client_sock, msg.c_str(), msg.size(), 0);
-}
-void handle_msg(int client_sock, const std::string& sender, const std::string& target, const std::string& message) {
-    std::lock_guard<std::mutex> lock(conn_mutex);
-    auto it = user_conn.find(target);
-    if (it != user_conn.end()) {
-        std::ostringstream oss;
-        oss << "MSG|[" << sender << "] " << message << "\n";
-        send_response(it->second, oss.str());
-        send_response(client_sock, "OK|메시지 전송 완료\n");
-    } else {
-        send_response(client_sock, "ERR|상대방이 온라인이 아님\n");
-    }
-}
+// ---- 공유 경로 접두사 트리 (수신자별) ----
+// 수신자마다 공유받은 경로를 '/' 단위 트리로 두어, 임의 경로의 권한을 가장 가까운 공유 조상으로 O(경로 길이)에 판정한다.
+// 공유 파일은 서버 시작 때 한 번만 읽고, 이후에는 share_map을 바꾸는 쪽이 해당 수신자의 트리만 reindex()로 다시 만든다.
+// 아래 함수들은 share_mutex를 잡고 호출해야 한다.
+namespace shares {
+    struct ShareNode {
+        std::map<std::string, std::unique_ptr<ShareNode>> children;
+        std::vector<std::string> owners;        // 이 경로를 공유해 준 유저들
+    };
+    std::map<std::string, ShareNode> share_index;
 
-// ---- 로그인/회원가입 및 중복 로그인 방지 ----
-bool try_login(const std::string& id, const std::string& pw, std::string& response) {
-    std::lock_guard<std::mutex> lock(user_mutex);
-    util::load_user_db();
-    if (!user_db.count(id)) {
-        response = "ERR|존재하지 않는 아이디입니다\n";
-        return false;
-    }
-    if (user_db[id] != pw) {
-        response = "ERR|비밀번호가 틀렸습니다\n";
-        return false;
+    // 공유 경로로 쓸 수 있는지: 비어 있거나 "..", "." 또는 빈 구성요소가 있으면 거부
+    // (트리는 가장 깊은 공유 조상으로 권한을 주므로, "공유폴더/../" 형태로 소유자 홈 밖을 가리키면 안 된다)
+    bool is_clean_path(std::string_view path) {
+        if (path.empty()) return false;
+        while (true) {
+            size_t slash = path.find('/');
+            std::string_view part = path.substr(0, slash);
+            if (part.empty() || part == "." || part == "..") return false;
+            if (slash == std::string_view::npos) return true;
+            path.remove_prefix(slash + 1);
+        }
     }
-    {
-        std::lock_guard<std::mutex> lock2(conn_mutex);
-        if (user_conn.count(id)) {
-            response = "ERR|이미 로그인 중인 계정입니다\n";
-            return false;
+    // recipient가 공유받은 항목만으로 그 수신자의 트리를 다시 만듦 (O(그 수신자의 공유 수))
+    void reindex(const std::string& recipient) {
+        share_index.erase(recipient);
+        for (auto it = share_map.lower_bound(recipient); it != share_map.upper_bound(recipient); ++it) {
+            const auto& kv = *it;
+            if (!is_clean_path(kv.second.second)) continue;
+            ShareNode* node = &share_index[kv.first];
+            std::istringstream iss(kv.second.second);
+            std::string part;
+            while (getline(iss, part, '/')) {
+                if (part.empty()) continue;
+                auto& child = node->children[part];
+                if (!child) child.reset(new ShareNode());
+                node = child.get();
+            }
+            node->owners.push_back(kv.second.first);
         }
     }
-    response = "OK|로그인 성공\n";
-    return true;
-}
-bool try_signup(const std::string& id, const std::string& pw, std::string& response) {
-    std::lock_guard<std::mutex> lock(user_mutex);
-    util::load_user_db();
-    if (user_db.count(id)) {
-        response = "ERR|이미 존재하는 아이디입니다. 다시 시도\n";
-        return false;
+    void rebuild_index() {
+        share_index.clear();
+        for (auto it = share_map.begin(); it != share_map.end(); it = share_map.upper_bound(it->first))
+            reindex(it->first);
     }
-    user_db[id] = pw;
-    util::save_user_db();
-    response = "OK|회원가입 및 로그인 성공\n";
-    return true;
-}
-
-// ---- 클라이언트 1명당 1스레드: 명령 반복 처리 루프 ----
-void handle_client(int client_sock) {
-    char buffer[BUFFER_SIZE];
-    std::string username;
-    bool logged_in = false;
-
-    send_response(client_sock, "OK|로그인 또는 회원가입 선택: (1) 로그인 (2) 회원가입 입력\n");
-
-    while (!logged_in) {
-        memset(buffer, 0, sizeof(buffer));
-        int len = recv(client_sock, buffer, sizeof(buffer)-1, 0);
-        if (len <= 0) return;
-        buffer[len] = 0;
-        std::istringstream iss(buffer);
-        std::string mode, id, pw;
-        getline(iss, mode, '|');
-        getline(iss, id, '|');
-        getline(iss, pw, '|');
-
-        std::string response;
-        if (mode == "1") {
-            if (try_login(id, pw, response)) {
-                username = id;
-                logged_in = true;
-                util::ensure_user_dir(username);
-                std::cout << "[안내] 사용자 '" << username << "' 로그인/접속\n";
+    // path를 포함하는 공유의 소유자 후보 (가장 깊은 공유 조상부터)
+    std::vector<std::string> resolve(const std::string& recipient, const std::string& path) {
+        std::vector<std::string> result;
+        if (!is_clean_path(path)) return result;
+        auto it = share_index.find(recipient);
+        if (it == share_index.end()) return result;
+        const ShareNode* node = &it->second;
+        size_t start = 0;
+        while (start <= path.size()) {
+            size_t slash = path.find('/', start);
+            if (slash == std::string::npos) slash = path.size();
+            if (slash > start) {
+                auto child = node->children.find(path.substr(start, slash - start));
+                if (child == node->children.end()) break;
+                node = child->second.get();
+                result.insert(result.begin(), node->owners.begin(), node->owners.end());
             }
-            send_response(client_sock, response);
+            start = slash + 1;
         }
-        else if (mode == "2") {
-            if (try_signup(id, pw, response)) {
-                username = id;
-                logged_in = true;
-                util::ensure_user_dir(username);
-                std::cout << "[안내] 사용자 '" << username << "' 회원가입 및 접속\n";
+        return result;
+    }
+    // 소유자가 rel(또는 그 하위)을 지웠을 때 관련 공유 제거. 변경이 있으면 true
+    bool on_owner_remove(const std::string& owner, const std::string& rel) {
+        std::set<std::string> touched;
+        std::string prefix = rel + "/";
+        for (auto it = share_map.begin(); it != share_map.end(); ) {
+            const auto& e = it->second;
+            if (e.first == owner && (e.second == rel || e.second.compare(0, prefix.size(), prefix) == 0)) {
+                touched.insert(it->first);
+                it = share_map.erase(it);
+            } else {
+                ++it;
             }
-            send_response(client_sock, response);
         }
-        else {
-            send_response(client_sock, "ERR|1 또는 2만 입력 가능\n");
+        if (touched.empty()) return false;
+        util::save_share_map();
+        for (const auto& recipient : touched) reindex(recipient);
+        return true;
+    }
+    // 소유자가 from을 to로 옮겼을 때 공유 경로도 따라 옮김
+    bool on_owner_move(const std::string& owner, const std::string& from, const std::string& to) {
+        std::set<std::string> touched;
+        std::string prefix = from + "/";
+        for (auto& kv : share_map) {
+            auto& e = kv.second;
+            if (e.first != owner) continue;
+            if (e.second == from) e.second = to;
+            else if (e.second.compare(0, prefix.size(), prefix) == 0) e.second = to + e.second.substr(from.size());
+            else continue;
+            touched.insert(kv.first);
         }
+        if (touched.empty()) return false;
+        util::save_share_map();
+        for (const auto& recipient : touched) reindex(recipient);
+        return true;
     }
+}
 
-    {
-        std::lock_guard<std::mutex> lock(conn_mutex);
-        user_conn[username] = client_sock;
+// ---- 유저별 사용량(디스크) 집계 및 용량 한도 ----
+// 폴더별 누적 바이트를 메모리에 유지하고, 파일 명령마다 증감분만 반영한다.
+// 사이드카 파일(server_data/usage/<유저>.du)에 저장하고, 백그라운드 스캐너가 주기적으로 실제 값과 맞춘다.
+// 아래 함수들은 호출 전에 usage_mutex를 잡고 있어야 한다 (load/reconcile 제외).
+namespace usage {
+    std::string parent_of(const std::string& rel) {
+        size_t slash = rel.find_last_of('/');
+        return slash == std::string::npos ? "" : rel.substr(0, slash);
     }
-    {
-        std::lock_guard<std::mutex> lock(share_mutex);
-        util::load_share_map();
+    // rel의 모든 상위 폴더(루트 "" 포함)에 delta 반영
+    void add_to_parents(std::map<std::string, long long>& tree, const std::string& rel, long long delta) {
+        std::string dir = rel;
+        do {
+            dir = parent_of(dir);
+            tree[dir] += delta;
+        } while (!dir.empty());
     }
-
-    while (true) {
-        memset(buffer, 0, sizeof(buffer));
-        int len = recv(client_sock, buffer, sizeof(buffer)-1, 0);
-        if (len <= 0) break;
-        buffer[len] = 0;
-        std::istringstream iss(buffer);
-        std::string cmd, arg1, arg2;
-        getline(iss, cmd, '|');
-        getline(iss, arg1, '|');
-        getline(iss, arg2, '|');
-
-        if (cmd == "/msg") {
-            std::string message = arg2;
-            std::string extra;
-            getline(iss, extra, '|');
-            if (!extra.empty()) message += "|" + extra;
-            if (!message.empty() && message.back() == '|') message.pop_back();
-            handle_msg(client_sock, username, arg1, message);
-        }
-        else if (cmd == "/who") {
-            std::ostringstream oss;
-            oss << "OK|";
-            {
-                std::lock_guard<std::mutex> lock(conn_mutex);
-                for (const auto& kv : user_conn)
-                    oss << kv.first << " ";
+    long long scan(const std::string& base, const std::string& rel, std::map<std::string, long long>& tree) {
+        std::string fullpath = base + (rel.empty() ? "" : "/" + rel);
+        long long total = 0;
+        DIR* dir = opendir(fullpath.c_str());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+                std::string child = rel.empty() ? entry->d_name : rel + "/" + entry->d_name;
+                struct stat st;
+                if (stat((base + "/" + child).c_str(), &st) != 0) continue;
+                if (S_ISDIR(st.st_mode)) total += scan(base, child, tree);
+                else total += st.st_size;
             }
-            oss << "\n";
-            send_response(client_sock, oss.str());
+            closedir(dir);
         }
-        else if (cmd == "/share") {
-            bool user_ok = false;
-            {
-                std::lock_guard<std::mutex> ulock(user_mutex);
-                util::load_user_db();
-                user_ok = user_db.count(arg2) > 0;
-            }
-            if (!user_ok) {
-                send_response(client_sock, "ERR|상대 유저 없음\n");
-                continue;
+        tree[rel] = total;
+        return total;
+    }
+    void save(const std::string& user) {
+        util::ensure_dir(USAGE_DIR);
+        std::ofstream ofs(USAGE_DIR + user + ".du");
+        for (const auto& kv : usage_db[user])
+            ofs << kv.second << " " << (kv.first.empty() ? "." : kv.first) << "\n";
+        usage_dirty.erase(user);
+    }
+    void load_quota() {
+        quota_db.clear();
+        std::ifstream ifs(QUOTA_FILE);
+        std::string id;
+        long long bytes;
+        while (ifs >> id >> bytes) quota_db[id] = bytes;
+    }
+    long long quota_of(const std::string& user) {
+        auto it = quota_db.find(user);
+        return it == quota_db.end() ? DEFAULT_QUOTA : it->second;
+    }
+    // 로그인 시 1회: 사이드카가 있으면 읽고, 없으면 전체 스캔
+    void ensure_loaded(const std::string& user) {
+        {
+            std::lock_guard<std::mutex> lock(usage_mutex);
+            if (usage_db.count(user)) return;
+        }
+        std::map<std::string, long long> tree;
+        std::ifstream ifs(USAGE_DIR + user + ".du");
+        bool from_sidecar = false;
+        if (ifs) {
+            long long bytes;
+            std::string rel;
+            // 경로는 마지막 필드이고 공백이 들어 있을 수 있으므로 줄 끝까지 읽음
+            while (ifs >> bytes >> std::ws && std::getline(ifs, rel)) tree[rel == "." ? "" : rel] = bytes;
+            from_sidecar = tree.count("") > 0;
+        }
+        if (!from_sidecar) {
+            tree.clear();
+            scan(DATA_ROOT + user, "", tree);
+        }
+        std::lock_guard<std::mutex> lock(usage_mutex);
+        if (usage_db.count(user)) return;
+        usage_db[user] = std::move(tree);
+        if (!from_sidecar) save(user);
+    }
+    long long used(const std::string& user) {
+        return usage_db[user][""];
+    }
+    // 폴더면 누적 합계, 없으면 -1 (O(log n) 조회)
+    long long dir_bytes(const std::string& user, const std::string& rel) {
+        auto& tree = usage_db[user];
+        auto it = tree.find(rel);
+        return it == tree.end() ? -1 : it->second;
+    }
+    // 증분 변경 표시: 저장 대상 + 세대 증가 (진행 중인 재계산 결과를 버리게 함)
+    void touch(const std::string& user) {
+        usage_dirty.insert(user);
+        ++usage_gen[user];
+    }
+    void on_file_write(const std::string& user, const std::string& rel, long long delta) {
+        if (delta == 0) return;
+        add_to_parents(usage_db[user], rel, delta);
+        touch(user);
+    }
+    void on_mkdir(const std::string& user, const std::string& rel) {
+        usage_db[user][rel] = 0;
+        touch(user);
+    }
+    // rel 이하 항목을 모두 트리에서 제거하고, 제거된 바이트 수 반환
+    long long detach(std::map<std::string, long long>& tree, const std::string& rel, bool is_dir, long long file_size,
+                     std::map<std::string, long long>* moved) {
+        long long bytes = file_size;
+        if (is_dir) {
+            auto it = tree.find(rel);
+            bytes = it == tree.end() ? 0 : it->second;
+            std::string prefix = rel + "/";
+            if (it != tree.end()) {
+                if (moved) (*moved)[""] = it->second;
+                tree.erase(it);
             }
-            {
-                std::lock_guard<std::mutex> slock(share_mutex);
-                util::load_share_map();
-                bool already = false;
-                for (auto it = share_map.lower_bound(arg2); it != share_map.upper_bound(arg2); ++it) {
-                    if (it->second.first == username && it->second.second == arg1) {
-                        already = true;
-                        break;
-                    }
-                }
-                if (already) {
-                    send_response(client_sock, "ERR|이미 공유한 항목입니다\n");
-                } else {
-                    share_map.insert({arg2, {username, arg1}});
-                    util::save_share_map();
-                    send_response(client_sock, "OK|공유 성공\n");
-                }
+            for (auto sub = tree.lower_bound(prefix); sub != tree.end() && sub->first.compare(0, prefix.size(), prefix) == 0; ) {
+                if (moved) (*moved)[sub->first.substr(prefix.size())] = sub->second;
+                sub = tree.erase(sub);
             }
         }
-        else if (cmd == "/unshare") {
+        add_to_parents(tree, rel, -bytes);
+        return bytes;
+    }
+    void on_remove(const std::string& user, const std::string& rel, bool is_dir, long long file_size) {
+        detach(usage_db[user], rel, is_dir, file_size, nullptr);
+        touch(user);
+    }
+    // 휴지통에서 되돌린 항목: subtree는 scan 결과(폴더일 때), bytes는 전체 크기
+    void on_restore(const std::string& user, const std::string& rel, const std::map<std::string, long long>& subtree, long long bytes) {
+        auto& tree = usage_db[user];
+        for (const auto& kv : subtree) tree[kv.first] = kv.second;
+        add_to_parents(tree, rel, bytes);
+        touch(user);
+    }
+    void on_move(const std::string& user, const std::string& from, const std::string& to, bool is_dir, long long file_size) {
+        auto& tree = usage_db[user];
+        std::map<std::string, long long> moved;
+        long long bytes = detach(tree, from, is_dir, file_size, &moved);
+        for (const auto& kv : moved)
+            tree[kv.first.empty() ? to : to + "/" + kv.first] = kv.second;
+        add_to_parents(tree, to, bytes);
+        touch(user);
+    }
+    // 백그라운드 스캐너: 접속 중이거나 저장 안 된 변경이 있는 유저만 실제 디스크와 재동기화하고,
+    // 접속하지 않은 유저는 사이드카에 저장한 뒤 메모리에서 내린다 (다음 로그인 때 ensure_loaded가 다시 읽음).
+    // 스캔은 락 없이 하므로, 그 사이 증분 변경이 있었으면(세대가 바뀌었으면) 결과를 버리고 다음 주기에 다시 한다.
+    bool is_online(const std::string& user) {
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        return user_conn.count(user) > 0;
+    }
+    void reconcile_loop() {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(USAGE_SCAN_INTERVAL_SEC));
+            std::vector<std::pair<std::string, unsigned long long>> targets;
             {
-                std::lock_guard<std::mutex> slock(share_mutex);
-                util::load_share_map();
-                bool found = false;
-                for (auto it = share_map.lower_bound(arg2); it != share_map.upper_bound(arg2); ) {
-                    if (it->second.first == username && it->second.second == arg1) {
-                        it = share_map.erase(it);
-                        found = true;
-                    } else {
+                std::lock_guard<std::mutex> lock(usage_mutex);
+                for (auto it = usage_db.begin(); it != usage_db.end(); ) {
+                    const std::string& user = it->first;
+                    if (is_online(user) || usage_dirty.count(user)) {
+                        targets.emplace_back(user, usage_gen[user]);
                         ++it;
+                    } else {
+                        usage_gen.erase(user);
+                        it = usage_db.erase(it);
                     }
                 }
-                if (found) {
-                    util::save_share_map();
-                    send_response(client_sock, "OK|공유 해제 성공\n");
-                } else {
-                    send_response(client_sock, "ERR|공유 항목 없음\n");
+            }
+            for (const auto& target : targets) {
+                const std::string& user = target.first;
+                std::map<std::string, long long> tree;
+                scan(DATA_ROOT + user, "", tree);
+                std::lock_guard<std::mutex> lock(usage_mutex);
+                auto cur = usage_db.find(user);
+                if (cur == usage_db.end()) continue;
+                if (usage_gen[user] != target.second) {
+                    std::cout << "[안내] 사용자 '" << user << "' 사용량 재계산 중 변경 발생: 다음 주기에 다시 계산\n";
+                    continue;
+                }
+                long long before = cur->second[""];
+                cur->second = std::move(tree);
+                if (before != cur->second[""])
+                    std::cout << "[안내] 사용자 '" << user << "' 사용량 재계산: " << before << " -> " << cur->second[""] << " bytes\n";
+                save(user);
+                if (!is_online(user)) {
+                    usage_gen.erase(user);
+                    usage_db.erase(cur);
                 }
             }
         }
-        else if (cmd == "/sharedwithme") {
-            std::ostringstream oss;
-            {
-                std::lock_guard<std::mutex> slock(share_mutex);
-                util::load_share_map();
-                for (auto it = share_map.lower_bound(username); it != share_map.upper_bound(username); ++it) {
-                    oss << "[FROM " << it->second.first << "] " << it->second.second << "\n";
+    }
+}
+
+// ---- 디렉토리 메타데이터 캐시 (inotify 무효화 + LRU) ----
+// /ls, /stat, /download, /search, /share 가 매번 readdir/stat 하지 않도록 폴더별 목록을 메모리에 둔다.
+// 서버 자신의 변경은 refresh_entry/drop_subtree로 즉시 반영하고, 외부 변경은 inotify 스레드가 반영한다.
+// 아래 함수들은 호출 전에 meta_mutex를 잡고 있어야 한다 (watch_loop, search 제외: 스스로 짧게 잡음).
+namespace meta {
+    struct EntryMeta {
+        bool is_dir = false;
+        long long size = 0;
+        time_t mtime = 0;
+    };
+    struct DirCache {
+        std::map<std::string, EntryMeta, std::less<>> entries;    // string_view로도 조회
+        int wd = -1;                               // inotify watch (-1이면 감시 실패 → 짧게만 유효)
+        time_t loaded_at = 0;
+        std::list<std::string>::iterator lru;
+    };
+    constexpr size_t MAX_CACHED_ENTRIES = 200000;  // 메모리 한도: 캐시된 항목 수 기준
+    constexpr int UNWATCHED_TTL_SEC = 2;
+
+    using DirMap = std::map<std::string, DirCache, std::less<>>;
+    DirMap dirs;                                   // 폴더 전체경로 -> 목록
+    std::list<std::string> lru;                    // 앞쪽이 최근 사용
+    std::map<int, std::string> wd_to_dir;
+    size_t cached_entries = 0;
+    int inotify_fd = -1;
+    unsigned long long generation = 0;             // 캐시 내용이 바뀔 때마다 증가 (락 밖에서 읽은 목록의 유효성 확인용)
+
+    bool to_meta(const std::string& fullpath, EntryMeta& out) {
+        struct stat st;
+        if (stat(fullpath.c_str(), &st) != 0) return false;
+        out.is_dir = S_ISDIR(st.st_mode);
+        out.size = out.is_dir ? 0 : st.st_size;
+        out.mtime = st.st_mtime;
+        return true;
+    }
+    void drop_dir(DirMap::iterator it) {
+        if (it->second.wd >= 0) {
+            inotify_rm_watch(inotify_fd, it->second.wd);
+            wd_to_dir.erase(it->second.wd);
+        }
+        cached_entries -= it->second.entries.size();
+        lru.erase(it->second.lru);
+        dirs.erase(it);
+    }
+    // path 폴더와 그 하위 폴더 캐시 전부 제거
+    void drop_subtree(const std::string& path) {
+        ++generation;
+        auto it = dirs.find(path);
+        if (it != dirs.end()) drop_dir(it);
+        std::string prefix = path + "/";
+        for (auto sub = dirs.lower_bound(prefix); sub != dirs.end() && sub->first.compare(0, prefix.size(), prefix) == 0; ) {
+            auto next = std::next(sub);
+            drop_dir(sub);
+            sub = next;
+        }
+    }
+    void evict_if_needed() {
+        while (cached_entries > MAX_CACHED_ENTRIES && lru.size() > 1)
+            drop_dir(dirs.find(lru.back()));
+    }
+    // 디스크에서 폴더 목록을 읽음 (전역 상태를 건드리지 않으므로 락 없이 호출 가능)
+    bool read_dir(const std::string& path, DirCache& dc) {
+        DIR* dp = opendir(path.c_str());
+        if (!dp) return false;
+        struct dirent* ep;
+        while ((ep = readdir(dp)) != nullptr) {
+            if (strcmp(ep->d_name, ".") == 0 || strcmp(ep->d_name, "..") == 0) continue;
+            EntryMeta em;
+            if (to_meta(path + "/" + ep->d_name, em)) dc.entries[ep->d_name] = em;
+        }
+        closedir(dp);
+        dc.loaded_at = time(nullptr);
+        return true;
+    }
+    // 읽은 목록을 캐시에 넣고 inotify 감시 등록
+    DirCache* install(const std::string& path, DirCache&& dc) {
+        if (inotify_fd >= 0) {
+            dc.wd = inotify_add_watch(inotify_fd, path.c_str(),
+                IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+            if (dc.wd >= 0) {
+                // 같은 inode를 다른 경로로 감시하던 항목(이름변경된 폴더)은 정리
+                auto old = wd_to_dir.find(dc.wd);
+                if (old != wd_to_dir.end() && old->second != path) {
+                    auto stale = dirs.find(old->second);
+                    if (stale != dirs.end()) {
+                        stale->second.wd = -1;
+                        drop_dir(stale);
+                    }
                 }
+                wd_to_dir[dc.wd] = path;
             }
-            std::string result = oss.str();
-            if (result.empty()) result = "(공유받은 항목 없음)\n";
-            send_response(client_sock, "OK|" + result);
         }
-        else if (cmd == "/ls") {
-            std::string dir = DATA_ROOT + username + (arg1.empty() ? "" : "/" + arg1);
-            std::string result = util::list_dir(dir);
-            send_response(client_sock, "OK|" + result);
+        cached_entries += dc.entries.size();
+        lru.push_front(path);
+        dc.lru = lru.begin();
+        auto& slot = dirs[path] = std::move(dc);
+        evict_if_needed();
+        return &slot;
+    }
+    // 캐시에 유효한 목록이 있으면 반환 (만료된 것은 제거)
+    DirCache* cached_dir(std::string_view dir) {
+        auto it = dirs.find(dir);
+        if (it == dirs.end()) return nullptr;
+        if (it->second.wd >= 0 || time(nullptr) - it->second.loaded_at <= UNWATCHED_TTL_SEC) {
+            lru.splice(lru.begin(), lru, it->second.lru);
+            return &it->second;
         }
-        else if (cmd == "/mkdir") {
-            std::string dir = DATA_ROOT + username + "/" + arg1;
-            if (util::make_dir(dir))
-                send_response(client_sock, "OK|폴더 생성 성공\n");
-            else
-                send_response(client_sock, "ERR|폴더 생성 실패\n");
+        drop_dir(it);
+        return nullptr;
+    }
+    // 폴더 목록 조회: 캐시에 없으면 읽어서 적재, 폴더가 아니면 nullptr (적중 시 할당 없음)
+    const DirCache* get_dir(std::string_view dir) {
+        if (DirCache* dc = cached_dir(dir)) return dc;
+        std::string path(dir);
+        DirCache dc;
+        if (!read_dir(path, dc)) return nullptr;
+        return install(path, std::move(dc));
+    }
+    // 부모 폴더가 캐시돼 있으면 fullpath 항목 하나만 다시 stat 해서 반영
+    void refresh_entry(const std::string& fullpath) {
+        ++generation;
+        size_t slash = fullpath.find_last_of('/');
+        if (slash == std::string::npos) return;
+        auto it = dirs.find(fullpath.substr(0, slash));
+        if (it == dirs.end()) return;
+        std::string name = fullpath.substr(slash + 1);
+        EntryMeta em;
+        auto& entries = it->second.entries;
+        bool had = entries.count(name) > 0;
+        if (to_meta(fullpath, em)) {
+            if (!had) ++cached_entries;
+            entries[name] = em;
+        } else if (had) {
+            entries.erase(name);
+            --cached_entries;
         }
-        else if (cmd == "/rm") {
-            std::string path = DATA_ROOT + username + "/" + arg1;
-            if (util::remove_path(path))
-                send_response(client_sock, "OK|삭제 성공\n");
-            else
-                send_response(client_sock, "ERR|삭제 실패\n");
+    }
+    // base(유저 홈) 기준 상대경로 rel의 메타데이터
+    bool stat_path(const std::string& base, std::string_view rel, EntryMeta& out) {
+        if (rel.empty()) {
+            if (!get_dir(base)) return false;
+            out = EntryMeta();
+            out.is_dir = true;
+            return true;
         }
-        else if (cmd == "/mv") {
-            std::string from = DATA_ROOT + username + "/" + arg1;
-            std::string to = DATA_ROOT + username + "/" + arg2;
-            if (util::move_path(from, to))
-                send_response(client_sock, "OK|이동/이름변경 성공\n");
-            else
-                send_response(client_sock, "ERR|이동/이름변경 실패\n");
-        }
-        else if (cmd == "/upload") {
-            std::string fpath = DATA_ROOT + username + "/" + arg1;
-            int filesize = stoi(arg2);
-            size_t slash = fpath.find_last_of('/');
-            if (slash != std::string::npos)
-                util::ensure_dir(fpath.substr(0, slash));
-            std::ofstream ofs(fpath, std::ios::binary);
-            int received = 0;
-            while (received < filesize) {
-                int to_read = std::min(BUFFER_SIZE, filesize - received);
-                int l = recv(client_sock, buffer, to_read, 0);
-                if (l <= 0) break;
-                ofs.write(buffer, l);
-                received += l;
-            }
-            ofs.close();
-            if (received != filesize) {
-                send_response(client_sock, "ERR|업로드 실패: 전송된 바이트(" + std::to_string(received) + ")와 파일 크기(" + std::to_string(filesize) + ") 불일치\n");
-                remove(fpath.c_str());
-                std::cout << "[경고] 사용자 '" << username << "' 파일 업로드 실패: " << arg1 << " (" << received << "/" << filesize << " bytes)\n";
-            } else {
-                send_response(client_sock, "OK|업로드 성공\n");
-                std::cout << "[안내] 사용자 '" << username << "' 파일 업로드: " << fpath << " (" << filesize << " bytes)\n";
+        thread_local std::string full;             // 스레드별로 재사용 (용량 유지)
+        full.assign(base).append("/").append(rel);
+        size_t slash = full.find_last_of('/');
+        std::string_view view(full);
+        const DirCache* dc = get_dir(view.substr(0, slash));
+        if (!dc) return false;
+        auto it = dc->entries.find(view.substr(slash + 1));
+        if (it == dc->entries.end()) return false;
+        out = it->second;
+        return true;
+    }
+    // 목록을 out 뒤에 덧붙임. 폴더가 아니면 false
+    bool list_dir(std::string_view path, std::string& out) {
+        const DirCache* dc = get_dir(path);
+        if (!dc) return false;
+        for (const auto& kv : dc->entries)
+            out.append(kv.second.is_dir ? "[DIR] " : "[FILE] ").append(kv.first).append("\n");
+        return true;
+    }
+    // 폴더 하나의 (이름, 폴더 여부) 목록. meta_mutex는 캐시를 보고 넣는 동안만 잡고, 디스크 읽기는 락 밖에서 한다.
+    // 읽는 사이 캐시가 바뀌었으면(generation 변화) 읽은 목록은 이번 호출에만 쓰고 캐시에는 넣지 않는다.
+    bool children_of(const std::string& dir, std::vector<std::pair<std::string, bool>>& out) {
+        out.clear();
+        unsigned long long gen;
+        {
+            std::lock_guard<std::mutex> lock(meta_mutex);
+            if (const DirCache* dc = cached_dir(dir)) {
+                for (const auto& kv : dc->entries) out.push_back({kv.first, kv.second.is_dir});
+                return true;
             }
+            gen = generation;
         }
-        else if (cmd == "/download") {
-            std::string fpath = DATA_ROOT + username + "/" + arg1;
-            struct stat st;
-            bool found = false, shared = false;
-            std::string owner;
-            if (stat(fpath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
-                found = true;
-            } else {
-                std::lock_guard<std::mutex> slock(share_mutex);
-                util::load_share_map();
-                for (auto it = share_map.lower_bound(username); it != share_map.upper_bound(username); ++it) {
-                    if (it->second.second == arg1) {
-                        owner = it->second.first;
-                        found = true;
-                        shared = true;
-                        break;
-                    }
+        DirCache dc;
+        if (!read_dir(dir, dc)) return false;
+        for (const auto& kv : dc.entries) out.push_back({kv.first, kv.second.is_dir});
+        std::lock_guard<std::mutex> lock(meta_mutex);
+        if (gen == generation && !dirs.count(dir)) install(dir, std::move(dc));
+        return true;
+    }
+    // 재귀 검색: 폴더마다 잠깐씩만 락을 잡으므로 큰 트리를 훑어도 다른 세션의 /ls, /stat 등을 막지 않음
+    void search(const std::string& base, const std::string& path, const std::string& keyword, std::vector<std::string>& results) {
+        std::vector<std::pair<std::string, bool>> children;
+        if (!children_of(base + (path.empty() ? "" : "/" + path), children)) return;
+        for (const auto& child : children) {
+            std::string rel = path.empty() ? child.first : path + "/" + child.first;
+            if (child.first.find(keyword) != std::string::npos) results.push_back(rel);
+            if (child.second) search(base, rel, keyword, results);
+        }
+    }
+    // 외부(다른 프로세스, 직접 파일 수정)에서 생긴 변경을 캐시에 반영
+    void watch_loop() {
+        alignas(struct inotify_event) char buf[16 * 1024];
+        while (true) {
+            ssize_t len = read(inotify_fd, buf, sizeof(buf));
+            if (len <= 0) {
+                if (len < 0 && errno == EINTR) continue;
+                break;
+            }
+            std::lock_guard<std::mutex> lock(meta_mutex);
+            ++generation;
+            for (char* p = buf; p < buf + len; ) {
+                auto* ev = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    while (!lru.empty()) drop_dir(dirs.find(lru.back()));
+                    continue;
                 }
-                if (found) {
-                    fpath = DATA_ROOT + owner + "/" + arg1;
-                    if (stat(fpath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
-                        send_response(client_sock, "ERR|파일 없음\n");
-                        continue;
-                    }
+                auto wit = wd_to_dir.find(ev->wd);
+                if (wit == wd_to_dir.end()) continue;
+                std::string dir = wit->second;
+                if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    drop_subtree(dir);
+                    continue;
                 }
-            }
-            if (!found) {
-                send_response(client_sock, "ERR|파일 없음\n");
-                continue;
-            }
-            int filesize = st.st_size;
-            std::ifstream ifs(fpath, std::ios::binary);
-            if (!ifs) {
-                send_response(client_sock, "ERR|파일 열기 실패\n");
-                continue;
-            }
-            std::ostringstream oss;
-            oss << "OK|" << filesize << "|";
-            send_response(client_sock, oss.str());
-            int sent = 0;
-            while (sent < filesize) {
-                int tosend = std::min(BUFFER_SIZE, filesize - sent);
-                ifs.read(buffer, tosend);
-                int l = send(client_sock, buffer, tosend, 0);
-                if (l <= 0) break;
-                sent += l;
-            }
-            ifs.close();
-            if (sent != filesize) {
-                std::cerr << "[다운로드 오류] 전송한 바이트(" << sent << ")와 파일 크기(" << filesize << ") 불일치: " << fpath << std::endl;
+                if (ev->len == 0) continue;
+                std::string full = dir + "/" + ev->name;
+                if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_DELETE | IN_MOVED_FROM)))
+                    drop_subtree(full);
+                refresh_entry(full);
             }
         }
-        else if (cmd == "/search") {
-            std::string keyword = arg1;
-            std::vector<std::string> results;
-            std::string userdir = DATA_ROOT + username;
-            util::search_recursive(userdir, "", keyword, results);
-            {
-                std::lock_guard<std::mutex> slock(share_mutex);
-                util::load_share_map();
-                for (auto it = share_map.lower_bound(username); it != share_map.upper_bound(username); ++it) {
-                    std::string fname = it->second.second;
-                    if (fname.find(keyword) != std::string::npos) {
-                        std::string shared_from = "[공유:" + it->second.first + "] " + fname;
-                        results.push_back(shared_from);
-                    }
-                }
+    }
+    void init() {
+        inotify_fd = inotify_init1(IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            std::cerr << "[경고] inotify 초기화 실패: 메타데이터 캐시는 짧은 TTL로만 동작\n";
+            return;
+        }
+        std::thread(watch_loop).detach();
+    }
+}
+
+// ---- 파일 체크섬 저장소 (조건부 다운로드, 전송 검증, 중복 제거/증분 동기화용) ----
+// 전체경로 -> (크기, 수정시각, CRC32C, 1MB 블록별 CRC, 선택적 SHA-256). 크기/수정시각이 다르면 무효로 본다.
+// 업로드 검증이나 다운로드 중에 계산한 값을 그대로 저장하므로 파일을 다시 읽지 않는다.
+// 변경은 server_data/checksums.log에 한 줄씩 덧붙이고, 시작 시(또는 로그가 커지면) 현재 항목만 남겨 다시 쓴다.
+namespace digest {
+    const std::string JOURNAL_FILE = "server_data/checksums.log";
+    struct Entry {
+        long long size = 0;
+        time_t mtime = 0;
+        uint32_t crc = 0;
+        std::vector<uint32_t> blocks;
+        std::string sha256;                     // --strong-hash일 때만
+    };
+    std::map<std::string, Entry> digest_db;
+    std::mutex digest_mutex;
+    bool strong = false;                        // --strong-hash: 전송 시 SHA-256도 계산/검증
+    std::ofstream journal;
+    long long journal_lines = 0;
+
+    std::string format(const std::string& path, const Entry& e) {
+        std::string blocks;
+        for (size_t i = 0; i < e.blocks.size(); ++i) blocks += (i ? "," : "") + checksum::crc_hex(e.blocks[i]);
+        return "+ " + std::to_string(e.size) + " " + std::to_string((long long)e.mtime) + " " + checksum::crc_hex(e.crc) + " " +
+               (e.sha256.empty() ? "-" : e.sha256) + " " + (blocks.empty() ? "-" : blocks) + " " + path;
+    }
+    void erase_prefix(const std::string& path) {
+        digest_db.erase(path);
+        std::string prefix = path + "/";
+        for (auto it = digest_db.lower_bound(prefix); it != digest_db.end() && it->first.compare(0, prefix.size(), prefix) == 0; )
+            it = digest_db.erase(it);
+    }
+    // 현재 항목만 남겨 로그를 다시 쓴다. digest_mutex 보유 상태에서 호출
+    void compact() {
+        if (journal.is_open()) journal.close();
+        std::string tmp = JOURNAL_FILE + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::trunc);
+            for (const auto& kv : digest_db) ofs << format(kv.first, kv.second) << "\n";
+        }
+        rename(tmp.c_str(), JOURNAL_FILE.c_str());
+        journal_lines = digest_db.size();
+    }
+    void append_journal(const std::string& line) {
+        if (!journal.is_open()) journal.open(JOURNAL_FILE, std::ios::app);
+        journal << line << "\n";
+        journal.flush();
+        if (++journal_lines > 4 * (long long)digest_db.size() + 1024) compact();
+    }
+    // 시작 시 로그 재생. 파일이 사라졌거나 바뀐 항목은 버린다.
+    void load() {
+        std::lock_guard<std::mutex> lock(digest_mutex);
+        std::ifstream ifs(JOURNAL_FILE);
+        std::string line;
+        while (getline(ifs, line)) {
+            std::istringstream iss(line);
+            std::string op, path;
+            iss >> op;
+            if (op == "-") {
+                iss >> std::ws;
+                getline(iss, path);
+                erase_prefix(path);
+                continue;
             }
-            std::ostringstream oss;
-            if (results.empty()) oss << "OK|(검색 결과 없음)\n";
-            else {
-                oss << "OK|";
-                for (const auto& r : results) oss << r << "\n";
+            Entry e;
+            long long mtime;
+            std::string crc, sha, blocks;
+            if (op != "+" || !(iss >> e.size >> mtime >> crc >> sha >> blocks)) continue;
+            iss >> std::ws;
+            getline(iss, path);
+            e.mtime = mtime;
+            e.crc = strtoul(crc.c_str(), nullptr, 16);
+            if (sha != "-") e.sha256 = sha;
+            if (blocks != "-") {
+                std::istringstream bss(blocks);
+                std::string b;
+                while (getline(bss, b, ',')) e.blocks.push_back(strtoul(b.c_str(), nullptr, 16));
             }
-            send_response(client_sock, oss.str());
+            digest_db[path] = e;
         }
-        else if (cmd == "/quit") {
-            std::cout << "[안내] 사용자 '" << username << "' 연결 종료\n";
-            break;
-        }
-        else {
-            send_response(client_sock, "ERR|알 수 없는 명령\n");
+        for (auto it = digest_db.begin(); it != digest_db.end(); ) {
+            struct stat st;
+            if (stat(it->first.c_str(), &st) != 0 || st.st_size != it->second.size || st.st_mtime != it->second.mtime)
+                it = digest_db.erase(it);
+            else
+                ++it;
         }
+        compact();
     }
-
-    {
-        std::lock_guard<std::mutex> lock(conn_mutex);
-        if (!username.empty()) user_conn.erase(username);
+    void put(const std::string& path, long long size, time_t mtime, const checksum::StreamChecksum& sum) {
+        std::lock_guard<std::mutex> lock(digest_mutex);
+        Entry& e = digest_db[path];
+        e = Entry{size, mtime, sum.crc, sum.blocks, sum.sha256};
+        append_journal(format(path, e));
+    }
+    // 저장된 값만 조회 (파일을 읽지 않음)
+    bool find(const std::string& path, long long size, time_t mtime, Entry& out) {
+        std::lock_guard<std::mutex> lock(digest_mutex);
+        auto it = digest_db.find(path);
+        if (it == digest_db.end() || it->second.size != size || it->second.mtime != mtime) return false;
+        out = it->second;
+        return true;
+    }
+    // 저장소에 없거나 낡았으면 파일을 한 번 읽어 계산
+    bool get(const std::string& path, long long size, time_t mtime, Entry& out) {
+        if (find(path, size, mtime, out)) return true;
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) return false;
+        char buf[BUFFER_SIZE];
+        checksum::StreamChecksum sum(strong);
+        while (ifs.read(buf, sizeof(buf)) || ifs.gcount() > 0)
+            sum.update(buf, ifs.gcount());
+        sum.finish();
+        put(path, size, mtime, sum);
+        out = Entry{size, mtime, sum.crc, sum.blocks, sum.sha256};
+        return true;
+    }
+    // 파일 CRC만 필요할 때 (블록 목록 복사 없이)
+    bool crc_of(const std::string& path, long long size, time_t mtime, uint32_t& out) {
+        {
+            std::lock_guard<std::mutex> lock(digest_mutex);
+            auto it = digest_db.find(path);
+            if (it != digest_db.end() && it->second.size == size && it->second.mtime == mtime) {
+                out = it->second.crc;
+                return true;
+            }
+        }
+        Entry e;
+        if (!get(path, size, mtime, e)) return false;
+        out = e.crc;
+        return true;
+    }
+    // path 자신과 하위 경로 항목 제거
+    void invalidate(const std::string& path) {
+        std::lock_guard<std::mutex> lock(digest_mutex);
+        auto it = digest_db.lower_bound(path);
+        if (it == digest_db.end() || it->first.compare(0, path.size(), path) != 0) return;   // 저장된 항목 없음
+        erase_prefix(path);
+        append_journal("- " + path);
+    }
+}
+
+// ---- 인기 파일 메모리 캐시 (TinyLFU 승인 + LRU 축출) ----
+// 여러 유저가 연달아 받는 작은/중간 크기 파일은 디스크 대신 메모리 버퍼에서 보낸다.
+// 같은 파일을 동시에 받는 연결들은 shared_ptr로 하나의 버퍼를 공유한다.
+// 접근 빈도는 count-min sketch로 추정하고, 자리를 비워야 할 때 새 파일이 축출 대상보다 자주 쓰였을 때만 넣는다.
+namespace hot {
+    constexpr long long MAX_FILE_SIZE = 16LL * 1024 * 1024;    // 이보다 큰 파일은 캐시하지 않음
+    constexpr long long MEMORY_BUDGET = 256LL * 1024 * 1024;
+    constexpr int SKETCH_ROWS = 4;
+    constexpr int SKETCH_WIDTH = 4096;
+    constexpr int SKETCH_RESET_AT = 10000;                      // 이만큼 기록하면 빈도를 절반으로 (오래된 인기 감쇠)
+
+    using Buffer = std::shared_ptr<const std::vector<char>>;
+    struct Entry {
+        Buffer data;
+        long long size = 0;
+        time_t mtime = 0;
+        std::list<std::string>::iterator lru;
+    };
+    std::mutex hot_mutex;
+    std::map<std::string, Entry> entries;
+    std::list<std::string> lru;                                 // 앞쪽이 최근 사용
+    std::set<std::string> loading;
+    long long memory_used = 0;
+    uint8_t sketch[SKETCH_ROWS][SKETCH_WIDTH];
+    int sketch_additions = 0;
+    std::atomic<long long> hits(0), misses(0), bytes_from_cache(0), bytes_from_disk(0);
+
+    size_t slot(const std::string& key, int row) {
+        return (std::hash<std::string>()(key) * (2 * row + 1) + row * 0x9e3779b97f4a7c15ULL) % SKETCH_WIDTH;
+    }
+    int frequency(const std::string& key) {
+        int f = 255;
+        for (int r = 0; r < SKETCH_ROWS; ++r) f = std::min<int>(f, sketch[r][slot(key, r)]);
+        return f;
+    }
+    void record_access(const std::string& key) {
+        for (int r = 0; r < SKETCH_ROWS; ++r) {
+            uint8_t& c = sketch[r][slot(key, r)];
+            if (c < 255) ++c;
+        }
+        if (++sketch_additions >= SKETCH_RESET_AT) {
+            for (auto& row : sketch)
+                for (auto& c : row) c >>= 1;
+            sketch_additions = 0;
+        }
+    }
+    void erase(std::map<std::string, Entry>::iterator it) {
+        memory_used -= it->second.size;
+        lru.erase(it->second.lru);
+        entries.erase(it);
+    }
+    // 캐시에 있고 크기/수정시각이 같으면 버퍼 반환, 아니면 nullptr
+    Buffer lookup(const std::string& path, long long size, time_t mtime) {
+        std::lock_guard<std::mutex> lock(hot_mutex);
+        record_access(path);
+        auto it = entries.find(path);
+        if (it != entries.end()) {
+            if (it->second.size == size && it->second.mtime == mtime) {
+                lru.splice(lru.begin(), lru, it->second.lru);
+                ++hits;
+                return it->second.data;
+            }
+            erase(it);
+        }
+        ++misses;
+        return nullptr;
+    }
+    // TinyLFU 승인: 이전에 본 적 있고, 필요한 만큼 비울 때 축출 대상들보다 빈도가 높아야 함
+    bool admit(const std::string& path, long long size) {
+        if (size <= 0 || size > MAX_FILE_SIZE) return false;
+        std::lock_guard<std::mutex> lock(hot_mutex);
+        if (loading.count(path)) return false;
+        int freq = frequency(path);
+        if (freq < 2) return false;
+        long long need = memory_used + size - MEMORY_BUDGET;
+        for (auto it = lru.rbegin(); need > 0 && it != lru.rend(); ++it) {
+            if (frequency(*it) >= freq) return false;
+            need -= entries[*it].size;
+        }
+        loading.insert(path);
+        return true;
+    }
+    // admit()가 true일 때만 호출: 파일을 읽어 캐시에 넣고 버퍼 반환 (실패 시 nullptr)
+    Buffer load(const std::string& path, long long size, time_t mtime) {
+        auto data = std::make_shared<std::vector<char>>(size);
+        std::ifstream ifs(path, std::ios::binary);
+        bool ok = ifs && ifs.read(data->data(), size) && ifs.gcount() == size;
+        std::lock_guard<std::mutex> lock(hot_mutex);
+        bool still_loading = loading.erase(path) > 0;
+        if (!ok || !still_loading) return nullptr;
+        auto old = entries.find(path);
+        if (old != entries.end()) erase(old);
+        while (memory_used + size > MEMORY_BUDGET && !lru.empty())
+            erase(entries.find(lru.back()));
+        lru.push_front(path);
+        Entry& e = entries[path];
+        e.data = data;
+        e.size = size;
+        e.mtime = mtime;
+        e.lru = lru.begin();
+        memory_used += size;
+        return data;
+    }
+    // 쓰기(/upload, /mv, /rm) 시 path 자신과 하위 경로 제거. 이미 버퍼를 받은 전송은 끝까지 기존 버퍼 사용
+    void invalidate(const std::string& path) {
+        std::lock_guard<std::mutex> lock(hot_mutex);
+        loading.erase(path);
+        auto it = entries.find(path);
+        if (it != entries.end()) erase(it);
+        std::string prefix = path + "/";
+        for (auto sub = entries.lower_bound(prefix); sub != entries.end() && sub->first.compare(0, prefix.size(), prefix) == 0; ) {
+            auto next = std::next(sub);
+            erase(sub);
+            sub = next;
+        }
+        for (auto sub = loading.lower_bound(prefix); sub != loading.end() && sub->compare(0, prefix.size(), prefix) == 0; )
+            sub = loading.erase(sub);
+    }
+    std::string stats() {
+        std::lock_guard<std::mutex> lock(hot_mutex);
+        std::ostringstream oss;
+        long long h = hits, m = misses;
+        oss << "[파일 캐시] 항목 " << entries.size() << "개, 메모리 " << memory_used << " / " << MEMORY_BUDGET
+            << " bytes, 적중 " << h << " / 실패 " << m;
+        if (h + m > 0) oss << " (적중률 " << (100 * h / (h + m)) << "%)";
+        oss << "\n  캐시에서 전송 " << (long long)bytes_from_cache << " bytes, 디스크에서 전송 " << (long long)bytes_from_disk << " bytes\n";
+        return oss.str();
+    }
+}
+
+// ---- 휴지통 (즉시 삭제 + 백그라운드 비우기) ----
+// /rm은 항목을 server_data/trash/<유저>/<id>로 rename만 하고 바로 응답한다 (하위 항목 수와 무관하게 O(1)).
+// 보관 기간 안에는 /restore로 되돌릴 수 있고, 기간이 지나거나 휴지통 전체가 한도를 넘으면 purge_loop가 초당 unlink 수를 제한하며 지운다.
+// 목록은 유저별 server_data/trash/<유저>/.index 에 "id 삭제시각 폴더여부 바이트 원래경로"로 저장한다.
+namespace trash {
+    const std::string TRASH_DIR = "server_data/trash/";
+    constexpr long long MAX_TRASH_BYTES = 1LL << 30;                  // 유저별 한도: 넘으면 그 유저 항목만 보관 기간 전이라도 오래된 것부터 비움
+    constexpr int PURGE_INTERVAL_SEC = 60;
+    constexpr int PURGE_OPS_PER_SEC = 2000;                            // 비우기 속도 제한 (unlink/rmdir 수)
+    int retention_days = 7;                                            // --trash-days (0이면 복구 없이 바로 비움)
+
+    struct Item {
+        std::string id;
+        std::string rel;
+        time_t deleted_at = 0;
+        bool is_dir = false;
+        long long bytes = 0;
+        bool purging = false;
+    };
+    std::mutex trash_mutex;
+    std::map<std::string, std::map<std::string, Item>> items;        // 유저 -> id -> 항목
+    std::condition_variable purge_wakeup;
+    long long id_counter = 0;
+
+    std::string user_dir(const std::string& user) { return TRASH_DIR + user; }
+    std::string path_of(const std::string& user, const std::string& id) { return TRASH_DIR + user + "/" + id; }
+    // trash_mutex 보유 상태에서 호출
+    void save(const std::string& user) {
+        std::string tmp = user_dir(user) + "/.index.tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::trunc);
+            for (const auto& kv : items[user]) {
+                const Item& it = kv.second;
+                ofs << it.id << " " << (long long)it.deleted_at << " " << it.is_dir << " " << it.bytes << " " << it.rel << "\n";
+            }
+        }
+        rename(tmp.c_str(), (user_dir(user) + "/.index").c_str());
+    }
+    // 시작 시 모든 유저의 목록을 읽음. 목록에 없는 항목(rename 직후 중단된 경우)은 지금 삭제된 것으로 취급
+    void load() {
+        util::ensure_dir(TRASH_DIR);
+        std::lock_guard<std::mutex> lock(trash_mutex);
+        DIR* root = opendir(TRASH_DIR.c_str());
+        if (!root) return;
+        struct dirent* ue;
+        while ((ue = readdir(root)) != nullptr) {
+            if (ue->d_name[0] == '.') continue;
+            std::string user = ue->d_name;
+            auto& list = items[user];
+            std::ifstream ifs(user_dir(user) + "/.index");
+            std::string line;
+            while (getline(ifs, line)) {
+                std::istringstream iss(line);
+                Item it;
+                long long deleted_at;
+                if (!(iss >> it.id >> deleted_at >> it.is_dir >> it.bytes)) continue;
+                iss >> std::ws;
+                getline(iss, it.rel);
+                it.deleted_at = deleted_at;
+                list[it.id] = it;
+            }
+            DIR* dp = opendir(user_dir(user).c_str());
+            if (!dp) continue;
+            struct dirent* e;
+            while ((e = readdir(dp)) != nullptr) {
+                if (e->d_name[0] == '.' || list.count(e->d_name)) continue;
+                Item it;
+                it.id = e->d_name;
+                it.rel = it.id;
+                it.deleted_at = time(nullptr);
+                struct stat st;
+                it.is_dir = stat(path_of(user, it.id).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                list[it.id] = it;
+            }
+            closedir(dp);
+            for (auto i = list.begin(); i != list.end(); ) {   // 목록에만 있고 실제로 없는 항목 정리
+                struct stat st;
+                if (stat(path_of(user, i->first).c_str(), &st) != 0) i = list.erase(i);
+                else ++i;
+            }
+            save(user);
+        }
+        closedir(root);
+    }
+    // DATA_ROOT/<user>/<rel> 를 휴지통으로 rename. 같은 파일시스템 안의 rename이므로 크기와 무관하게 즉시 끝남
+    bool move_in(const std::string& user, const std::string& rel, bool is_dir, long long bytes) {
+        std::lock_guard<std::mutex> lock(trash_mutex);
+        util::ensure_dir(TRASH_DIR);
+        util::ensure_dir(user_dir(user));
+        Item it;
+        it.deleted_at = time(nullptr);
+        it.id = std::to_string((long long)it.deleted_at) + "-" + std::to_string(++id_counter);
+        it.rel = rel;
+        it.is_dir = is_dir;
+        it.bytes = bytes;
+        if (!util::move_path(DATA_ROOT + user + "/" + rel, path_of(user, it.id))) return false;
+        items[user][it.id] = it;
+        save(user);
+        if (retention_days == 0) purge_wakeup.notify_one();
+        return true;
+    }
+    // "#id" 또는 원래 경로(같은 경로가 여러 번 지워졌으면 가장 최근 것)로 항목 찾기. trash_mutex 보유 상태에서 호출
+    Item* find(const std::string& user, const std::string& key) {
+        auto& list = items[user];
+        if (!key.empty() && key[0] == '#') {
+            auto i = list.find(key.substr(1));
+            return i == list.end() ? nullptr : &i->second;
+        }
+        Item* best = nullptr;
+        for (auto& kv : list)
+            if (kv.second.rel == key && (!best || kv.second.deleted_at >= best->deleted_at)) best = &kv.second;
+        return best;
+    }
+    bool peek(const std::string& user, const std::string& key, Item& out) {
+        std::lock_guard<std::mutex> lock(trash_mutex);
+        Item* it = find(user, key);
+        if (it) out = *it;
+        return it != nullptr;
+    }
+    // 휴지통 항목을 DATA_ROOT/<user>/<to> 로 되돌림. 성공 시 목록에서 제거하고 항목 정보를 out에 돌려줌
+    // 없는 상위 폴더는 모두 만들고 그 상대경로를 created에 (위쪽부터) 담는다. 실패하면 원인 설명을 반환
+    std::string restore(const std::string& user, const std::string& key, const std::string& to_arg, Item& out,
+                        std::vector<std::string>& created) {
+        std::lock_guard<std::mutex> lock(trash_mutex);
+        Item* it = find(user, key);
+        if (!it || it->purging) return "휴지통에 없는 항목";
+        if (time(nullptr) - it->deleted_at > retention_days * 86400LL) return "보관 기간이 지난 항목";
+        std::string to = to_arg.empty() ? it->rel : to_arg;
+        std::string dest = DATA_ROOT + user + "/" + to;
+        struct stat st;
+        if (stat(dest.c_str(), &st) == 0) return "같은 이름이 이미 있음 (다른 경로를 지정하세요)";
+        std::string error;
+        for (size_t slash = 0; error.empty() && (slash = to.find('/', slash)) != std::string::npos; ++slash) {
+            std::string parent = to.substr(0, slash);
+            std::string full = DATA_ROOT + user + "/" + parent;
+            if (stat(full.c_str(), &st) == 0) {
+                if (!S_ISDIR(st.st_mode)) error = "상위 경로 '" + parent + "'가 폴더가 아님";
+            } else if (mkdir(full.c_str(), 0755) == 0) {
+                created.push_back(parent);
+            } else {
+                error = "상위 폴더 '" + parent + "' 생성 실패 (" + strerror(errno) + ")";
+            }
+        }
+        if (error.empty() && !util::move_path(path_of(user, it->id), dest))
+            error = std::string("휴지통에서 옮기기 실패 (") + strerror(errno) + ")";
+        if (!error.empty()) {
+            for (auto c = created.rbegin(); c != created.rend(); ++c) rmdir((DATA_ROOT + user + "/" + *c).c_str());
+            created.clear();
+            return error;
+        }
+        out = *it;
+        out.rel = to;
+        items[user].erase(out.id);
+        save(user);
+        return "";
+    }
+    std::string describe(const std::string& user) {
+        std::lock_guard<std::mutex> lock(trash_mutex);
+        std::ostringstream oss;
+        oss << "OK|휴지통 (보관 " << retention_days << "일)\n";
+        const auto& list = items[user];
+        if (list.empty()) oss << "(비어 있음)\n";
+        for (const auto& kv : list) {
+            const Item& it = kv.second;
+            char when[32];
+            std::tm tm_buf;
+            localtime_r(&it.deleted_at, &tm_buf);
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm_buf);
+            oss << "#" << it.id << "  " << when << "  " << (it.is_dir ? "[DIR] " : "[FILE] ") << it.rel << " (" << it.bytes << " bytes)\n";
+        }
+        return oss.str();
+    }
+    // 보관 기간이 지난 항목, 그리고 휴지통 크기가 유저별 한도를 넘은 유저의 가장 오래된 항목을 골라 하나씩 비움
+    // (한도는 유저마다 따로 적용: 한 유저가 휴지통을 채워도 다른 유저 항목은 보관 기간 동안 남는다)
+    void purge_loop() {
+        auto pace = [](size_t ops) { std::this_thread::sleep_for(std::chrono::microseconds(ops * 1000000 / PURGE_OPS_PER_SEC)); };
+        while (true) {
+            std::string user, id;
+            {
+                std::unique_lock<std::mutex> lock(trash_mutex);
+                time_t now = time(nullptr);
+                const Item* victim = nullptr;
+                for (const auto& u : items) {
+                    long long total = 0;
+                    const Item* oldest = nullptr;
+                    for (const auto& kv : u.second) {
+                        const Item& it = kv.second;
+                        if (it.purging) continue;
+                        total += it.bytes;
+                        if (!oldest || it.deleted_at < oldest->deleted_at) oldest = &it;
+                    }
+                    if (!oldest || (now - oldest->deleted_at < retention_days * 86400LL && total <= MAX_TRASH_BYTES)) continue;
+                    if (!victim || oldest->deleted_at < victim->deleted_at) {
+                        victim = oldest;
+                        user = u.first;
+                    }
+                }
+                if (!victim) {
+                    purge_wakeup.wait_for(lock, std::chrono::seconds(PURGE_INTERVAL_SEC));
+                    continue;
+                }
+                id = victim->id;
+                items[user][id].purging = true;
+            }
+            util::remove_path(path_of(user, id), pace);
+            std::lock_guard<std::mutex> lock(trash_mutex);
+            items[user].erase(id);
+            save(user);
+        }
+    }
+}
+
+// ---- 채팅 기록 저장소 ----
+// 대화 상대 쌍마다 server_data/history/<A>__<B>/ 아래 추가 전용 세그먼트 파일(<첫 seq>.seg)에 메시지를 쌓는다.
+// 레코드: [u32 길이][u64 seq][i64 시각][u16 보낸이 길이][보낸이][본문]
+// 읽기는 세그먼트를 mmap해서 하고, 메모리의 희소 인덱스(seq, 시각 -> 위치)로 끝부분/범위 조회 시작점을 바로 찾는다.
+// 보내는 쪽은 write()만 하고, 커밋 스레드가 모아서 fdatasync 한다 (메시지마다 fsync 하지 않음).
+namespace history {
+    const std::string HISTORY_DIR = "server_data/history/";
+    constexpr size_t SEGMENT_MAX = 4 * 1024 * 1024;        // 세그먼트 최대 크기
+    constexpr int INDEX_EVERY = 64;                         // 이 개수마다 인덱스 지점 기록
+    constexpr int COMMIT_INTERVAL_MS = 50;                  // 그룹 커밋 주기
+    constexpr int RETENTION_DAYS = 90;                      // 이보다 오래된 세그먼트는 삭제
+    constexpr size_t MAX_CONVERSATION_BYTES = 64 * 1024 * 1024;
+    constexpr int COMPACT_INTERVAL_SEC = 3600;
+    constexpr int DEFAULT_COUNT = 20;
+    constexpr int PAGE_MAX = 100;
+    constexpr size_t HEADER_SIZE = 4 + 8 + 8 + 2;
+
+    struct Segment {
+        uint64_t first_seq = 0;
+        std::string path;
+        size_t size = 0;
+        int64_t last_ts = 0;
+        char* map = nullptr;
+        size_t map_len = 0;
+    };
+    struct IndexPoint {
+        uint64_t seq;
+        int64_t ts;
+        size_t seg;         // segs 내 위치
+        size_t offset;
+    };
+    struct Record {
+        uint64_t seq;
+        int64_t ts;
+        std::string sender, text;
+    };
+    struct Conversation {
+        std::mutex m;
+        std::string dir;
+        std::vector<Segment> segs;
+        std::vector<IndexPoint> index;
+        uint64_t next_seq = 1;
+        int64_t last_ts = 0;
+        int fd = -1;                                        // 현재(마지막) 세그먼트 추가용
+        bool dirty = false;
+    };
+    std::mutex history_mutex;
+    std::map<std::string, std::unique_ptr<Conversation>> conversations;
+
+    // 아이디 안의 '_'와 '/'를 "_5f", "_2f"로 바꿔, 이스케이프된 이름에는 "__"가 나올 수 없게 한다.
+    // 그래야 "a__b"+"c"와 "a"+"b__c"처럼 서로 다른 두 쌍이 같은 폴더를 쓰지 않는다 ('_' 없는 아이디는 기존 폴더 이름 그대로).
+    std::string escape_id(const std::string& id) {
+        std::string out;
+        for (char ch : id) {
+            if (ch == '_') out += "_5f";
+            else if (ch == '/') out += "_2f";
+            else out += ch;
+        }
+        return out;
+    }
+    std::string key_of(const std::string& a, const std::string& b) {
+        return a < b ? escape_id(a) + "__" + escape_id(b) : escape_id(b) + "__" + escape_id(a);
+    }
+    // 세그먼트 읽기용 매핑 (파일이 커졌으면 다시 매핑)
+    const char* mapped(Segment& seg) {
+        if (seg.size == 0) return nullptr;
+        if (seg.map && seg.map_len >= seg.size) return seg.map;
+        if (seg.map) munmap(seg.map, seg.map_len);
+        seg.map = nullptr;
+        int fd = open(seg.path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        void* p = mmap(nullptr, seg.size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) return nullptr;
+        seg.map = (char*)p;
+        seg.map_len = seg.size;
+        return seg.map;
+    }
+    void unmap(Segment& seg) {
+        if (seg.map) munmap(seg.map, seg.map_len);
+        seg.map = nullptr;
+        seg.map_len = 0;
+    }
+    bool parse(const char* base, size_t size, size_t offset, Record* out, size_t& next) {
+        if (offset + HEADER_SIZE > size) return false;
+        uint32_t len;
+        uint16_t slen;
+        memcpy(&len, base + offset, 4);
+        if (len < HEADER_SIZE - 4 || offset + 4 + len > size) return false;
+        memcpy(&slen, base + offset + 20, 2);
+        if (HEADER_SIZE + slen > 4 + len) return false;
+        if (out) {
+            memcpy(&out->seq, base + offset + 4, 8);
+            memcpy(&out->ts, base + offset + 12, 8);
+            out->sender.assign(base + offset + HEADER_SIZE, slen);
+            out->text.assign(base + offset + HEADER_SIZE + slen, 4 + len - HEADER_SIZE - slen);
+        }
+        next = offset + 4 + len;
+        return true;
+    }
+    // 디스크의 세그먼트를 훑어 인덱스를 만들고, 마지막 세그먼트의 잘린 꼬리는 잘라낸다
+    void load(Conversation& c) {
+        std::vector<uint64_t> firsts;
+        if (DIR* dp = opendir(c.dir.c_str())) {
+            struct dirent* ep;
+            while ((ep = readdir(dp)) != nullptr) {
+                const char* dot = strstr(ep->d_name, ".seg");
+                if (dot && dot[4] == 0) firsts.push_back(strtoull(ep->d_name, nullptr, 10));
+            }
+            closedir(dp);
+        }
+        std::sort(firsts.begin(), firsts.end());
+        for (uint64_t first : firsts) {
+            Segment seg;
+            seg.first_seq = first;
+            char name[32];
+            snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)first);
+            seg.path = c.dir + name;
+            struct stat st;
+            if (stat(seg.path.c_str(), &st) != 0) continue;
+            seg.size = st.st_size;
+            const char* base = mapped(seg);
+            size_t offset = 0, next;
+            Record r;
+            int n = 0;
+            c.next_seq = std::max(c.next_seq, first);
+            while (base && parse(base, seg.size, offset, &r, next)) {
+                if (n++ % INDEX_EVERY == 0) c.index.push_back({r.seq, r.ts, c.segs.size(), offset});
+                c.next_seq = r.seq + 1;
+                c.last_ts = std::max(c.last_ts, r.ts);
+                seg.last_ts = r.ts;
+                offset = next;
+            }
+            if (offset < seg.size) {
+                unmap(seg);
+                if (truncate(seg.path.c_str(), offset) != 0) continue;
+                seg.size = offset;
+            }
+            c.segs.push_back(std::move(seg));
+        }
+    }
+    Conversation& open_conversation(const std::string& key) {
+        std::lock_guard<std::mutex> lock(history_mutex);
+        auto& slot = conversations[key];
+        if (!slot) {
+            slot.reset(new Conversation());
+            slot->dir = HISTORY_DIR + key + "/";
+            load(*slot);
+        }
+        return *slot;
+    }
+    // 새 세그먼트 시작 (c.m 잡은 상태)
+    bool roll(Conversation& c) {
+        if (c.fd >= 0) {
+            fdatasync(c.fd);
+            close(c.fd);
+            c.fd = -1;
+        }
+        util::ensure_dir(HISTORY_DIR);
+        util::ensure_dir(c.dir);
+        Segment seg;
+        seg.first_seq = c.next_seq;
+        char name[32];
+        snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)c.next_seq);
+        seg.path = c.dir + name;
+        c.fd = open(seg.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (c.fd < 0) return false;
+        c.segs.push_back(std::move(seg));
+        return true;
+    }
+    void append(const std::string& from, const std::string& to, std::string text) {
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+        Conversation& c = open_conversation(key_of(from, to));
+        std::lock_guard<std::mutex> lock(c.m);
+        uint16_t slen = std::min<size_t>(from.size(), 65535);
+        uint32_t len = HEADER_SIZE - 4 + slen + text.size();
+        if (c.fd < 0 && !c.segs.empty()) {
+            c.fd = open(c.segs.back().path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        }
+        if (c.fd < 0 || c.segs.back().size + 4 + len > SEGMENT_MAX) {
+            if (!roll(c)) return;
+        }
+        uint64_t seq = c.next_seq;
+        int64_t ts = std::max<int64_t>(c.last_ts, time(nullptr));     // 시각은 단조 증가로 유지 (시각 기준 이진탐색용)
+        std::string rec(4 + len, '\0');
+        memcpy(&rec[0], &len, 4);
+        memcpy(&rec[4], &seq, 8);
+        memcpy(&rec[12], &ts, 8);
+        memcpy(&rec[20], &slen, 2);
+        memcpy(&rec[HEADER_SIZE], from.data(), slen);
+        memcpy(&rec[HEADER_SIZE + slen], text.data(), text.size());
+        if (write(c.fd, rec.data(), rec.size()) != (ssize_t)rec.size()) return;
+        Segment& seg = c.segs.back();
+        if ((seq - seg.first_seq) % INDEX_EVERY == 0)
+            c.index.push_back({seq, ts, c.segs.size() - 1, seg.size});
+        seg.size += rec.size();
+        seg.last_ts = ts;
+        c.next_seq = seq + 1;
+        c.last_ts = ts;
+        c.dirty = true;
+    }
+    // from_seq 이상이고 since(0이면 무시) 이후인 레코드를 limit개까지 수집.
+    // 각 조건의 시작 지점(from_seq 이하 / since 이전의 마지막 인덱스 지점) 중 더 뒤쪽을 이진탐색으로 찾아 거기서부터만 훑는다.
+    std::vector<Record> scan(Conversation& c, uint64_t from_seq, int64_t since, size_t limit) {
+        std::vector<Record> out;
+        auto it = std::upper_bound(c.index.begin(), c.index.end(), std::make_pair(from_seq, since),
+            [](const std::pair<uint64_t, int64_t>& key, const IndexPoint& p) {
+                return p.seq > key.first && (key.second == 0 || p.ts >= key.second);
+            });
+        size_t seg_i = 0, offset = 0;
+        if (it != c.index.begin()) {
+            --it;
+            seg_i = it->seg;
+            offset = it->offset;
+        }
+        for (; seg_i < c.segs.size() && out.size() < limit; ++seg_i, offset = 0) {
+            Segment& seg = c.segs[seg_i];
+            const char* base = mapped(seg);
+            size_t next;
+            Record r;
+            while (base && out.size() < limit && parse(base, seg.size, offset, &r, next)) {
+                if (r.seq >= from_seq && r.ts >= since) out.push_back(std::move(r));
+                offset = next;
+            }
+        }
+        return out;
+    }
+    uint64_t oldest_seq(Conversation& c) {
+        return c.segs.empty() ? c.next_seq : c.segs.front().first_seq;
+    }
+    std::string format(const std::vector<Record>& records) {
+        std::string out;
+        char when[32];
+        for (const auto& r : records) {
+            time_t t = r.ts;
+            struct tm tmv;
+            localtime_r(&t, &tmv);
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tmv);
+            out += "#" + std::to_string(r.seq) + " [" + when + "] " + r.sender + ": " + r.text + "\n";
+        }
+        return out;
+    }
+    // "YYYY-MM-DD" 또는 "YYYY-MM-DDTHH:MM[:SS]" (서버 로컬 시각)
+    bool parse_time(const std::string& s, int64_t& out) {
+        struct tm tmv;
+        memset(&tmv, 0, sizeof(tmv));
+        const char* end = strptime(s.c_str(), "%Y-%m-%dT%H:%M:%S", &tmv);
+        if (!end || *end) {
+            memset(&tmv, 0, sizeof(tmv));
+            end = strptime(s.c_str(), "%Y-%m-%dT%H:%M", &tmv);
+        }
+        if (!end || *end) {
+            memset(&tmv, 0, sizeof(tmv));
+            end = strptime(s.c_str(), "%Y-%m-%d", &tmv);
+        }
+        if (!end || *end) return false;
+        tmv.tm_isdst = -1;
+        out = mktime(&tmv);
+        return true;
+    }
+    // /history <상대> [n | 날짜 | #seq | [n]<#seq]
+    std::string query(const std::string& me, const std::string& peer, std::string arg) {
+        while (!arg.empty() && (arg.back() == '\n' || arg.back() == '\r' || arg.back() == ' ')) arg.pop_back();
+        std::string key = key_of(me, peer);
+        struct stat st;
+        {
+            std::lock_guard<std::mutex> lock(history_mutex);
+            if (!conversations.count(key) && stat((HISTORY_DIR + key).c_str(), &st) != 0)
+                return "OK|(대화 기록 없음)\n";
+        }
+        Conversation& c = open_conversation(key);
+        std::lock_guard<std::mutex> lock(c.m);
+        std::vector<Record> records;
+        std::string footer;
+        bool forward = false, backward = false;
+        uint64_t start_seq = 0, end_seq = c.next_seq;
+        int64_t since = 0;
+        std::string count = arg;
+        size_t before = arg.find("<#");
+        if (before != std::string::npos) {
+            // "[n]<#seq": seq 바로 앞의 n개 (이전 페이지)
+            count = arg.substr(0, before);
+            end_seq = std::min<uint64_t>(strtoull(arg.c_str() + before + 2, nullptr, 10), c.next_seq);
+        }
+        auto all_digits = [](const std::string& v) { return std::all_of(v.begin(), v.end(), [](unsigned char ch) { return isdigit(ch); }); };
+        if ((before != std::string::npos || arg.empty() || all_digits(arg)) && all_digits(count)) {
+            // 최근 n개, 또는 end_seq 앞의 n개
+            backward = true;
+        } else if (arg[0] == '#') {
+            start_seq = strtoull(arg.c_str() + 1, nullptr, 10);
+            forward = true;
+        } else if (parse_time(arg, since)) {
+            forward = true;
+        } else {
+            return "ERR|사용법: /history <상대> [개수 | YYYY-MM-DD[THH:MM] | #번호 | [개수]<#번호]\n";
+        }
+        if (backward) {
+            long long n = count.empty() ? DEFAULT_COUNT : std::min<long long>(atoll(count.c_str()), PAGE_MAX);
+            if (n <= 0) return "ERR|개수는 1 이상\n";
+            start_seq = std::max<uint64_t>(end_seq > (uint64_t)n ? end_seq - n : 0, oldest_seq(c));
+            if (end_seq > start_seq) records = scan(c, start_seq, 0, end_seq - start_seq);
+            if (!records.empty() && records.front().seq > oldest_seq(c))
+                footer = "(이전 페이지: /history " + peer + " " + std::to_string(n) + "<#" + std::to_string(records.front().seq) + ")\n";
+        }
+        if (forward) {
+            records = scan(c, start_seq, since, PAGE_MAX + 1);
+            if (records.size() > (size_t)PAGE_MAX) {
+                footer = "(다음 페이지: /history " + peer + " #" + std::to_string(records.back().seq) + ")\n";
+                records.pop_back();
+            }
+        }
+        if (records.empty()) return "OK|(대화 기록 없음)\n";
+        return "OK|" + format(records) + footer;
+    }
+    // 그룹 커밋: 주기적으로 변경된 대화만 fdatasync
+    void commit_loop() {
+        auto last_compact = std::chrono::steady_clock::now();
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(COMMIT_INTERVAL_MS));
+            std::vector<Conversation*> all;
+            {
+                std::lock_guard<std::mutex> lock(history_mutex);
+                for (auto& kv : conversations) all.push_back(kv.second.get());
+            }
+            bool compact = std::chrono::steady_clock::now() - last_compact > std::chrono::seconds(COMPACT_INTERVAL_SEC);
+            if (compact) last_compact = std::chrono::steady_clock::now();
+            for (Conversation* c : all) {
+                int fd = -1;
+                {
+                    std::lock_guard<std::mutex> lock(c->m);
+                    if (c->dirty && c->fd >= 0) fd = dup(c->fd);
+                    c->dirty = false;
+                }
+                if (fd >= 0) {
+                    fdatasync(fd);
+                    close(fd);
+                }
+                if (!compact) continue;
+                // 보존 정책: 기간이 지났거나 용량을 넘은 오래된 세그먼트부터 삭제 (현재 세그먼트는 유지)
+                std::lock_guard<std::mutex> lock(c->m);
+                int64_t cutoff = time(nullptr) - (int64_t)RETENTION_DAYS * 86400;
+                size_t total = 0;
+                for (const auto& seg : c->segs) total += seg.size;
+                size_t drop = 0;
+                while (drop + 1 < c->segs.size() &&
+                       (c->segs[drop].last_ts < cutoff || total > MAX_CONVERSATION_BYTES)) {
+                    total -= c->segs[drop].size;
+                    unmap(c->segs[drop]);
+                    remove(c->segs[drop].path.c_str());
+                    ++drop;
+                }
+                if (drop == 0) continue;
+                c->segs.erase(c->segs.begin(), c->segs.begin() + drop);
+                std::vector<IndexPoint> kept;
+                for (auto p : c->index) {
+                    if (p.seg < drop) continue;
+                    p.seg -= drop;
+                    kept.push_back(p);
+                }
+                c->index.swap(kept);
+            }
+        }
+    }
+}
+
+// ---- 전송 대역폭 스케줄러 ----
+// 다운로드(대용량) 전송은 연결별/유저별 토큰 버킷과 전체 송신 예산을 모두 통과해야 한 청크를 보낼 수 있다.
+// 대기 중인 전송끼리는 가중치 공정 큐(WFQ)로 가상 종료시각이 가장 작은 쪽이 먼저 예산을 받는다.
+// 제어 응답과 MSG| 푸시는 기다리지 않고 바로 보내되 전체 예산에서 차감(빚)되어 대용량 전송이 양보한다.
+namespace bw {
+    enum TrafficClass { CLS_CONTROL, CLS_MSG, CLS_BULK, CLS_COUNT };
+    const char* CLASS_NAMES[CLS_COUNT] = { "control", "msg", "bulk" };
+    using Clock = std::chrono::steady_clock;
+
+    struct TokenBucket {
+        double rate = 0;          // 초당 바이트, 0이면 무제한
+        double tokens = 0;
+        Clock::time_point last = Clock::now();
+        double burst() const { return std::max(rate / 10, (double)BUFFER_SIZE * 8); }
+        void refill(Clock::time_point now) {
+            if (rate > 0) tokens = std::min(burst(), tokens + rate * std::chrono::duration<double>(now - last).count());
+            last = now;
+        }
+        bool has(double n) const { return rate <= 0 || tokens >= n; }
+        void take(double n) { if (rate > 0) tokens -= n; }
+        // 토큰이 n개 모일 때까지 남은 시간(초)
+        double wait_sec(double n) const { return rate <= 0 || tokens >= n ? 0 : (n - tokens) / rate; }
+    };
+    struct Flow {
+        std::string user;
+        int sock;
+        double finish_tag = 0;    // WFQ 가상 종료시각
+        bool waiting = false;
+        size_t want = 0;
+    };
+
+    std::mutex bw_mutex;
+    std::condition_variable bw_cv;
+    TokenBucket global_bucket;
+    double default_user_rate = 0, default_conn_rate = 0;
+    std::map<std::string, double> user_rate, user_weight;
+    std::map<std::string, TokenBucket> user_buckets;
+    std::map<int, TokenBucket> conn_buckets;
+    std::map<int, Flow> flows;
+    int next_flow_id = 1;
+    double virtual_time = 0;
+    std::atomic<long long> class_bytes[CLS_COUNT];
+    long long reported_bytes[CLS_COUNT] = {};
+    Clock::time_point reported_at = Clock::now();
+
+    double weight_of(const std::string& user) {
+        auto it = user_weight.find(user);
+        return it == user_weight.end() ? 1.0 : it->second;
+    }
+    TokenBucket& user_bucket(const std::string& user) {
+        auto it = user_buckets.find(user);
+        if (it != user_buckets.end()) return it->second;
+        TokenBucket& b = user_buckets[user];
+        auto r = user_rate.find(user);
+        b.rate = r == user_rate.end() ? default_user_rate : r->second;
+        return b;
+    }
+    TokenBucket& conn_bucket(int sock) {
+        auto it = conn_buckets.find(sock);
+        if (it != conn_buckets.end()) return it->second;
+        TokenBucket& b = conn_buckets[sock];
+        b.rate = default_conn_rate;
+        return b;
+    }
+    // 대기 없이 보내는 트래픽(제어/메시지): 통계만 올리고 전체 예산에서 차감
+    void account(TrafficClass cls, size_t bytes) {
+        class_bytes[cls] += bytes;
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        global_bucket.refill(Clock::now());
+        global_bucket.take(bytes);
+    }
+    int begin_flow(const std::string& user, int sock) {
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        int id = next_flow_id++;
+        Flow& f = flows[id];
+        f.user = user;
+        f.sock = sock;
+        f.finish_tag = virtual_time;
+        return id;
+    }
+    void end_flow(int id) {
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        auto it = flows.find(id);
+        if (it == flows.end()) return;
+        int sock = it->second.sock;
+        std::string user = it->second.user;
+        flows.erase(it);
+        bool sock_used = false, user_used = false;
+        for (const auto& kv : flows) {
+            sock_used |= kv.second.sock == sock;
+            user_used |= kv.second.user == user;
+        }
+        if (!sock_used) conn_buckets.erase(sock);
+        if (!user_used) user_buckets.erase(user);
+        bw_cv.notify_all();
+    }
+    // 대용량 전송 한 청크(bytes)를 보내기 전에 호출: 예산이 허락될 때까지 블록
+    void acquire(int id, size_t bytes) {
+        std::unique_lock<std::mutex> lock(bw_mutex);
+        Flow& f = flows[id];
+        f.finish_tag = std::max(f.finish_tag, virtual_time) + bytes / weight_of(f.user);
+        f.waiting = true;
+        f.want = bytes;
+        while (true) {
+            auto now = Clock::now();
+            global_bucket.refill(now);
+            TokenBucket& ub = user_bucket(f.user);
+            TokenBucket& cb = conn_bucket(f.sock);
+            ub.refill(now);
+            cb.refill(now);
+            double wait = std::max(ub.wait_sec(bytes), cb.wait_sec(bytes));
+            if (wait == 0) {
+                // 자기 버킷은 통과: 통과 가능한 대기자 중 가상 종료시각이 가장 작아야 전체 예산을 받음
+                bool first = true;
+                for (const auto& kv : flows) {
+                    const Flow& o = kv.second;
+                    if (kv.first == id || !o.waiting || o.finish_tag >= f.finish_tag) continue;
+                    auto ou = user_buckets.find(o.user);
+                    auto oc = conn_buckets.find(o.sock);
+                    if ((ou == user_buckets.end() || ou->second.has(o.want)) &&
+                        (oc == conn_buckets.end() || oc->second.has(o.want))) {
+                        first = false;
+                        break;
+                    }
+                }
+                if (first) {
+                    if (global_bucket.has(bytes)) break;
+                    wait = global_bucket.wait_sec(bytes);
+                } else {
+                    wait = 0.005;
+                }
+            }
+            bw_cv.wait_for(lock, std::chrono::duration<double>(std::min(std::max(wait, 0.001), 0.1)));
+        }
+        global_bucket.take(bytes);
+        user_bucket(f.user).take(bytes);
+        conn_bucket(f.sock).take(bytes);
+        virtual_time = std::max(virtual_time, f.finish_tag - bytes / weight_of(f.user));
+        f.waiting = false;
+        class_bytes[CLS_BULK] += bytes;
+        lock.unlock();
+        bw_cv.notify_all();
+    }
+    // "10M", "512K", "0"(무제한) -> 초당 바이트
+    bool parse_rate(const std::string& s, double& out) {
+        char* end = nullptr;
+        double v = strtod(s.c_str(), &end);
+        if (end == s.c_str() || v < 0) return false;
+        switch (toupper(*end)) {
+            case 'G': v *= 1024; // fallthrough
+            case 'M': v *= 1024; // fallthrough
+            case 'K': v *= 1024; ++end; break;
+            case 0: break;
+            default: return false;
+        }
+        if (toupper(*end) == 'B') ++end;
+        if (*end) return false;
+        out = v;
+        return true;
+    }
+    std::string describe() {
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        std::ostringstream oss;
+        oss << "[대역폭] 전체 " << (long long)global_bucket.rate << " B/s, 유저 기본 " << (long long)default_user_rate
+            << " B/s, 연결 기본 " << (long long)default_conn_rate << " B/s (0 = 무제한), 진행 중 전송 " << flows.size() << "\n";
+        for (const auto& kv : user_rate) oss << "  유저 " << kv.first << ": " << (long long)kv.second << " B/s\n";
+        for (const auto& kv : user_weight) oss << "  가중치 " << kv.first << ": " << kv.second << "\n";
+        return oss.str();
+    }
+    // 지난 metrics 조회 이후 클래스별 처리량
+    std::string metrics() {
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        auto now = Clock::now();
+        double secs = std::max(1e-3, std::chrono::duration<double>(now - reported_at).count());
+        std::ostringstream oss;
+        oss << "[트래픽] 최근 " << (long long)secs << "초\n";
+        for (int c = 0; c < CLS_COUNT; ++c) {
+            long long total = class_bytes[c];
+            oss << "  " << CLASS_NAMES[c] << ": 누적 " << total << " bytes, "
+                << (long long)((total - reported_bytes[c]) / secs) << " B/s\n";
+            reported_bytes[c] = total;
+        }
+        reported_at = now;
+        return oss.str();
+    }
+    // 서버 콘솔 명령: bw global|user|conn|weight ...
+    std::string configure(std::istringstream& iss) {
+        std::string what, a, b;
+        iss >> what >> a >> b;
+        double v;
+        std::lock_guard<std::mutex> lock(bw_mutex);
+        if (what == "global" && parse_rate(a, v)) {
+            global_bucket.rate = v;
+            global_bucket.tokens = 0;
+        } else if (what == "user" && b.empty() && parse_rate(a, v)) {
+            default_user_rate = v;
+            user_buckets.clear();
+        } else if (what == "user" && parse_rate(b, v)) {
+            user_rate[a] = v;
+            user_buckets.erase(a);
+        } else if (what == "conn" && parse_rate(a, v)) {
+            default_conn_rate = v;
+            conn_buckets.clear();
+        } else if (what == "weight" && parse_rate(b, v) && v > 0) {
+            user_weight[a] = v;
+        } else {
+            return "사용법: bw global <속도> | bw user [아이디] <속도> | bw conn <속도> | bw weight <아이디> <가중치>  (예: 10M, 512K, 0=무제한)\n";
+        }
+        bw_cv.notify_all();
+        return "[안내] 대역폭 설정 변경\n";
+    }
+}
+
+// ---- 클러스터 모드: 일관 해싱으로 유저를 노드에 배정 ----
+// 각 서버 프로세스(노드)는 해시 링에서 자기에게 배정된 유저만 로그인시키고, 나머지는 담당 노드로 안내(REDIRECT)한다.
+// 다른 노드 유저에게 가는 /msg 와 /who 는 내부 링크(클라이언트 포트 + PEER_PORT_OFFSET)로 담당 노드에 전달한다.
+// 내부 링크는 연결당 요청 한 줄 / 응답 한 줄.
+namespace cluster {
+    constexpr int PEER_PORT_OFFSET = 1000;
+    constexpr int VNODES = 128;              // 노드당 가상 노드 수 (분배 균형)
+    constexpr int PEER_TIMEOUT_SEC = 2;
+    constexpr int MAX_CLOCK_SKEW_SEC = 30;   // 서명된 내부 요청의 허용 시각 차이 (재전송 방지)
+    struct Node {
+        std::string id, host;
+        int port = 0;
+    };
+    bool enabled = false;
+    std::string self_id;
+    std::string secret;                      // --cluster-secret: 내부 요청 서명용 공유 비밀 (없으면 주소 확인만)
+    std::vector<Node> nodes;
+    std::map<uint32_t, size_t> ring;        // 해시 -> nodes 위치
+
+    uint32_t hash32(const std::string& s) {
+        uint32_t h = 2166136261u;
+        for (unsigned char ch : s) {
+            h ^= ch;
+            h *= 16777619u;
+        }
+        // FNV만으로는 비슷한 키가 몰리므로 마무리 섞기
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+    }
+    // "--node n1 --peers n1=127.0.0.1:9001,n2=127.0.0.1:9002" (자기 자신 포함)
+    bool configure(const std::string& self, const std::string& peers) {
+        std::istringstream iss(peers);
+        std::string item;
+        while (getline(iss, item, ',')) {
+            size_t eq = item.find('='), colon = item.rfind(':');
+            if (eq == std::string::npos || colon == std::string::npos || colon < eq) return false;
+            Node n;
+            n.id = item.substr(0, eq);
+            n.host = item.substr(eq + 1, colon - eq - 1);
+            n.port = atoi(item.c_str() + colon + 1);
+            if (n.id.empty() || n.port <= 0) return false;
+            nodes.push_back(n);
+        }
+        bool found_self = false;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            found_self |= nodes[i].id == self;
+            for (int v = 0; v < VNODES; ++v) ring[hash32(nodes[i].id + "#" + std::to_string(v))] = i;
+        }
+        self_id = self;
+        enabled = found_self;
+        return found_self;
+    }
+    const Node& owner_of(const std::string& user) {
+        auto it = ring.lower_bound(hash32(user));
+        if (it == ring.end()) it = ring.begin();
+        return nodes[it->second];
+    }
+    bool is_local(const std::string& user) {
+        return !enabled || owner_of(user).id == self_id;
+    }
+    const Node* find_node(const std::string& id) {
+        for (const auto& n : nodes)
+            if (n.id == id) return &n;
+        return nullptr;
+    }
+    const Node* self() {
+        return find_node(self_id);
+    }
+    bool host_matches(const Node& n, const in_addr& addr) {
+        in_addr host;
+        return inet_pton(AF_INET, n.host.c_str(), &host) > 0 && host.s_addr == addr.s_addr;
+    }
+    // 설정된 노드 주소에서 온 연결인지
+    bool is_peer_addr(const in_addr& addr) {
+        for (const auto& n : nodes)
+            if (host_matches(n, addr)) return true;
+        return false;
+    }
+
+    // ---- 내부 요청 서명 ----
+    // 요청 한 줄: "NODE|<보낸 노드>|<유닉스 시각>|<서명>|<본문>"
+    // 서명은 HMAC-SHA256(secret, "<보낸 노드>|<시각>|<본문>"), 비밀이 없으면 "-"
+    std::string hmac(const std::string& data) {
+        unsigned char key[64] = {0};
+        if (secret.size() > 64) {
+            checksum::Sha256 kh;
+            kh.update(secret.data(), secret.size());
+            std::string hex = kh.hex_digest();
+            for (int i = 0; i < 32; ++i) key[i] = (unsigned char)strtoul(hex.substr(2 * i, 2).c_str(), nullptr, 16);
+        } else {
+            memcpy(key, secret.data(), secret.size());
+        }
+        char ipad[64], opad[64];
+        for (int i = 0; i < 64; ++i) {
+            ipad[i] = (char)(key[i] ^ 0x36);
+            opad[i] = (char)(key[i] ^ 0x5c);
+        }
+        checksum::Sha256 inner;
+        inner.update(ipad, 64);
+        inner.update(data.data(), data.size());
+        std::string inner_hex = inner.hex_digest();
+        char inner_raw[32];
+        for (int i = 0; i < 32; ++i) inner_raw[i] = (char)strtoul(inner_hex.substr(2 * i, 2).c_str(), nullptr, 16);
+        checksum::Sha256 outer;
+        outer.update(opad, 64);
+        outer.update(inner_raw, 32);
+        return outer.hex_digest();
+    }
+    std::string seal(const std::string& payload) {
+        std::string when = std::to_string((long long)time(nullptr));
+        std::string mac = secret.empty() ? "-" : hmac(self_id + "|" + when + "|" + payload);
+        return "NODE|" + self_id + "|" + when + "|" + mac + "|" + payload;
+    }
+    bool same_text(const std::string& a, const std::string& b) {
+        if (a.size() != b.size()) return false;
+        unsigned char diff = 0;
+        for (size_t i = 0; i < a.size(); ++i) diff |= (unsigned char)(a[i] ^ b[i]);
+        return diff == 0;
+    }
+    // 보낸 노드가 설정 목록에 있고, 그 노드의 주소에서 왔고, (비밀이 있으면) 서명과 시각이 맞는지 확인
+    bool open_sealed(const std::string& line, const in_addr& from, std::string& node_id, std::string& payload) {
+        if (line.compare(0, 5, "NODE|") != 0) return false;
+        size_t p1 = line.find('|', 5);
+        size_t p2 = p1 == std::string::npos ? p1 : line.find('|', p1 + 1);
+        size_t p3 = p2 == std::string::npos ? p2 : line.find('|', p2 + 1);
+        if (p3 == std::string::npos) return false;
+        node_id = line.substr(5, p1 - 5);
+        std::string when = line.substr(p1 + 1, p2 - p1 - 1), mac = line.substr(p2 + 1, p3 - p2 - 1);
+        payload = line.substr(p3 + 1);
+        const Node* n = find_node(node_id);
+        if (!n || !host_matches(*n, from)) return false;
+        if (secret.empty()) return true;
+        if (llabs(atoll(when.c_str()) - (long long)time(nullptr)) > MAX_CLOCK_SKEW_SEC) return false;
+        return same_text(mac, hmac(node_id + "|" + when + "|" + payload));
+    }
+    // 다른 노드에 요청 한 줄을 보내고 응답 한 줄을 받음 (실패 시 빈 문자열)
+    std::string request(const Node& node, const std::string& line) {
+        std::string sealed = seal(line);
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0) return "";
+        timeval tv{PEER_TIMEOUT_SEC, 0};
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(node.port + PEER_PORT_OFFSET);
+        std::string reply;
+        if (inet_pton(AF_INET, node.host.c_str(), &addr.sin_addr) > 0 &&
+            connect(s, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+            send(s, (sealed + "\n").c_str(), sealed.size() + 1, MSG_NOSIGNAL) == (ssize_t)sealed.size() + 1) {
+            char buf[BUFFER_SIZE];
+            int l;
+            while ((l = recv(s, buf, sizeof(buf), 0)) > 0) {
+                reply.append(buf, l);
+                if (reply.back() == '\n') break;
+            }
+            if (!reply.empty() && reply.back() == '\n') reply.pop_back();
+        }
+        close(s);
+        return reply;
+    }
+    std::string describe() {
+        std::ostringstream oss;
+        if (!enabled) return "[클러스터] 단일 노드 모드\n";
+        oss << "[클러스터] 이 노드: " << self_id << "\n";
+        for (const auto& n : nodes)
+            oss << "  " << n.id << " " << n.host << ":" << n.port << " (내부 " << n.port + PEER_PORT_OFFSET << ")\n";
+        return oss.str();
+    }
+}
+
+// ---- 클라이언트와의 통신 및 명령 핸들러 ----
+void send_response(int client_sock, std::string_view msg, bw::TrafficClass cls = bw::CLS_CONTROL) {
+    bw::account(cls, msg.size());
+    send(client_sock, msg.data(), msg.size(), 0);
+}
+// 파일 본문 뒤의 체크섬 트레일러 한 줄 수신 (다음 명령을 먹지 않도록 '\n'까지만 꺼냄)
+bool recv_line(int sock, std::string& line, size_t max_len = 256 * 1024) {
+    line.clear();
+    char buf[BUFFER_SIZE];
+    while (line.size() < max_len) {
+        int l = recv(sock, buf, sizeof(buf), MSG_PEEK);
+        if (l <= 0) return false;
+        char* nl = (char*)memchr(buf, '\n', l);
+        int take = nl ? (int)(nl - buf) + 1 : l;
+        if (recv(sock, buf, take, 0) != take) return false;
+        line.append(buf, take);
+        if (nl) {
+            line.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+// 이 노드에 접속 중인 target에게 MSG| 푸시
+bool deliver_local(const std::string& sender, const std::string& target, const std::string& message) {
+    std::lock_guard<std::mutex> lock(conn_mutex);
+    auto it = user_conn.find(target);
+    if (it == user_conn.end()) return false;
+    std::ostringstream oss;
+    oss << "MSG|[" << sender << "] " << message << "\n";
+    send_response(it->second, oss.str(), bw::CLS_MSG);
+    return true;
+}
+void handle_msg(int client_sock, const std::string& sender, const std::string& target, const std::string& message) {
+    bool delivered;
+    if (cluster::is_local(target)) {
+        delivered = deliver_local(sender, target, message);
+    } else {
+        // 담당 노드로 전달 (내부 링크는 한 줄 단위이므로 줄바꿈 제거)
+        std::string text = message;
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+        std::string reply = cluster::request(cluster::owner_of(target), "MSG|" + sender + "|" + target + "|" + text);
+        if (reply.empty()) {
+            send_response(client_sock, "ERR|상대방 노드에 연결할 수 없음\n");
+            return;
+        }
+        delivered = reply == "OK";
+    }
+    if (delivered) {
+        history::append(sender, target, message);
+        send_response(client_sock, "OK|메시지 전송 완료\n");
+    } else {
+        send_response(client_sock, "ERR|상대방이 온라인이 아님\n");
+    }
+}
+
+// 내 것이 아닌 rel을 공유 트리로 권한 확인 후, 실제로 존재하는 소유자와 메타데이터를 찾음
+bool resolve_shared(const std::string& user, const std::string& rel, meta::EntryMeta& em, std::string& owner) {
+    if (!shares::is_clean_path(rel)) return false;
+    std::vector<std::string> owners;
+    {
+        std::lock_guard<std::mutex> slock(share_mutex);
+        owners = shares::resolve(user, rel);
+    }
+    std::lock_guard<std::mutex> mlock(meta_mutex);
+    for (const auto& o : owners) {
+        if (meta::stat_path(DATA_ROOT + o, rel, em)) {
+            owner = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---- 클러스터 내부 링크: 다른 노드의 요청 처리 ----
+void handle_peer(int peer_sock, in_addr peer_addr) {
+    timeval tv{cluster::PEER_TIMEOUT_SEC, 0};
+    setsockopt(peer_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string line;
+    char buf[BUFFER_SIZE];
+    int l;
+    while (line.find('\n') == std::string::npos && (l = recv(peer_sock, buf, sizeof(buf), 0)) > 0)
+        line.append(buf, l);
+    std::string reply = "ERR", caller;
+    if (!cluster::open_sealed(line.substr(0, line.find('\n')), peer_addr, caller, line)) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer_addr, ip, sizeof(ip));
+        std::cerr << "[경고] 인증되지 않은 클러스터 내부 요청 거부: " << ip << "\n";
+        line.clear();
+    }
+    if (line.compare(0, 4, "MSG|") == 0) {
+        // MSG|보낸이|받는이|본문 (본문에는 '|'가 있을 수 있음)
+        size_t p1 = line.find('|', 4), p2 = p1 == std::string::npos ? p1 : line.find('|', p1 + 1);
+        std::string from = p2 == std::string::npos ? "" : line.substr(4, p1 - 4);
+        // 보낸 노드가 담당하는 유저만 보낸이로 인정하고, 받는이는 이 노드 담당이어야 함
+        if (p2 != std::string::npos && cluster::owner_of(from).id == caller && cluster::is_local(line.substr(p1 + 1, p2 - p1 - 1))) {
+            std::string to = line.substr(p1 + 1, p2 - p1 - 1), text = line.substr(p2 + 1);
+            if (deliver_local(from, to, text)) {
+                history::append(from, to, text);
+                reply = "OK";
+            } else {
+                reply = "OFFLINE";
+            }
+        }
+    } else if (line == "WHO") {
+        std::ostringstream oss;
+        oss << "OK|";
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        for (const auto& kv : user_conn) oss << kv.first << " ";
+        reply = oss.str();
+    }
+    reply += "\n";
+    send(peer_sock, reply.c_str(), reply.size(), MSG_NOSIGNAL);
+    close(peer_sock);
+}
+void peer_listen_loop(int peer_port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(peer_port);
+    // --peers에 적힌 이 노드 주소에만 bind (모든 인터페이스에 열지 않음)
+    if (inet_pton(AF_INET, cluster::self()->host.c_str(), &addr.sin_addr) <= 0 ||
+        bind(s, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(s, 16) < 0) {
+        std::cerr << "[경고] 클러스터 내부 포트 " << cluster::self()->host << ":" << peer_port << " 열기 실패\n";
+        return;
+    }
+    while (true) {
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        int ps = accept(s, (sockaddr*)&from, &from_len);
+        if (ps < 0) continue;
+        // 설정된 노드 주소가 아니면 읽지도 않고 끊음
+        if (!cluster::is_peer_addr(from.sin_addr)) {
+            close(ps);
+            continue;
+        }
+        std::thread(handle_peer, ps, from.sin_addr).detach();
+    }
+}
+
+// ---- 로그인/회원가입 및 중복 로그인 방지 ----
+bool try_login(const std::string& id, const std::string& pw, std::string& response) {
+    std::lock_guard<std::mutex> lock(user_mutex);
+    util::load_user_db();
+    if (!user_db.count(id)) {
+        response = "ERR|존재하지 않는 아이디입니다\n";
+        return false;
+    }
+    if (user_db[id] != pw) {
+        response = "ERR|비밀번호가 틀렸습니다\n";
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock2(conn_mutex);
+        if (user_conn.count(id)) {
+            response = "ERR|이미 로그인 중인 계정입니다\n";
+            return false;
+        }
+    }
+    response = "OK|로그인 성공\n";
+    return true;
+}
+bool try_signup(const std::string& id, const std::string& pw, std::string& response) {
+    std::lock_guard<std::mutex> lock(user_mutex);
+    util::load_user_db();
+    if (user_db.count(id)) {
+        response = "ERR|이미 존재하는 아이디입니다. 다시 시도\n";
+        return false;
+    }
+    user_db[id] = pw;
+    util::save_user_db();
+    response = "OK|회원가입 및 로그인 성공\n";
+    return true;
+}
+
+// ---- 클라이언트 명령 파싱/디스패치 ----
+// 명령 줄 "명령|arg1|arg2|"를 수신 버퍼 위의 string_view로 나눈다 (복사/할당 없음).
+// 명령 이름은 constexpr FNV-1a 해시로 열린 주소 테이블에서 찾고, 핸들러는 정의 옆에서 Registrar로 등록한다.
+// 새 명령은 핸들러 함수와 Registrar 한 줄만 추가하면 되고 handle_client는 고칠 필요가 없다.
+namespace command {
+    struct Args {
+        std::string_view name, arg1, arg2;
+        std::string_view tail;                  // arg1 뒤 전부 ('|'가 들어간 메시지 본문용)
+    };
+    // 연결 하나의 상태. 응답/경로 버퍼는 명령마다 clear만 하고 할당된 용량은 재사용한다.
+    struct Session {
+        int sock = -1;
+        std::string username;
+        std::string home;                       // DATA_ROOT + username
+        char buffer[BUFFER_SIZE];
+        std::string out;
+        std::string path;
+        bool quit = false;
+    };
+    using Handler = void (*)(Session&, const Args&);
+
+    constexpr uint32_t hash(std::string_view name) {
+        uint32_t h = 2166136261u;
+        for (char c : name) {
+            h ^= (unsigned char)c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+    constexpr size_t TABLE_SIZE = 64;           // 2의 거듭제곱, 등록 명령 수의 2배 이상 유지
+    struct Slot {
+        std::string_view name;
+        Handler handler = nullptr;
+    };
+    Slot table[TABLE_SIZE];                     // 상수 초기화되므로 Registrar보다 먼저 준비됨
+
+    void add(std::string_view name, Handler handler) {
+        for (size_t i = hash(name) & (TABLE_SIZE - 1), n = 0; n < TABLE_SIZE; i = (i + 1) & (TABLE_SIZE - 1), ++n) {
+            if (!table[i].handler || table[i].name == name) {
+                table[i] = Slot{name, handler};
+                return;
+            }
+        }
+        std::cerr << "[오류] 명령 테이블이 가득 참: " << name << "\n";
+        abort();
+    }
+    Handler find(std::string_view name) {
+        for (size_t i = hash(name) & (TABLE_SIZE - 1), n = 0; n < TABLE_SIZE && table[i].handler; i = (i + 1) & (TABLE_SIZE - 1), ++n)
+            if (table[i].name == name) return table[i].handler;
+        return nullptr;
+    }
+    struct Registrar {
+        Registrar(std::string_view name, Handler handler) { add(name, handler); }
+    };
+
+    std::string_view next_field(std::string_view& rest, char sep = '|') {
+        size_t bar = rest.find(sep);
+        std::string_view field = rest.substr(0, bar);
+        rest = bar == std::string_view::npos ? std::string_view() : rest.substr(bar + 1);
+        return field;
+    }
+    // 끝의 줄바꿈을 떼고 '|'로 나눔. 없는 필드는 빈 문자열
+    Args parse(std::string_view line) {
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.remove_suffix(1);
+        Args a;
+        a.name = next_field(line);
+        a.arg1 = next_field(line);
+        a.tail = line;
+        a.arg2 = next_field(line);
+        return a;
+    }
+    // 숫자가 아니면 -1
+    long long to_num(std::string_view text) {
+        long long value = -1;
+        auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+        return res.ec == std::errc() && res.ptr == text.data() + text.size() ? value : -1;
+    }
+    void append_num(std::string& out, long long value) {
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, res.ptr - digits);
+    }
+}
+
+// 본문에 '|'가 있어도 잘리지 않도록 arg1 뒤 전부를 메시지로 사용
+void cmd_msg(command::Session& s, const command::Args& a) {
+    std::string_view message = a.tail;
+    if (!message.empty() && message.back() == '|') message.remove_suffix(1);
+    handle_msg(s.sock, s.username, std::string(a.arg1), std::string(message));
+}
+const command::Registrar reg_msg("/msg", cmd_msg);
+
+void cmd_history(command::Session& s, const command::Args& a) {
+    if (a.arg1.empty()) {
+        send_response(s.sock, "ERR|대화 상대를 입력하세요\n");
+        return;
+    }
+    send_response(s.sock, history::query(s.username, std::string(a.arg1), std::string(a.arg2)));
+}
+const command::Registrar reg_history("/history", cmd_history);
+
+void cmd_who(command::Session& s, const command::Args&) {
+    s.out.assign("OK|");
+    {
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        for (const auto& kv : user_conn)
+            s.out.append(kv.first).append(" ");
+    }
+    if (cluster::enabled) {
+        for (const auto& node : cluster::nodes) {
+            if (node.id == cluster::self_id) continue;
+            std::string reply = cluster::request(node, "WHO");
+            if (reply.compare(0, 3, "OK|") == 0) s.out.append(reply, 3, std::string::npos);
+        }
+    }
+    s.out.append("\n");
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_who("/who", cmd_who);
+
+void cmd_share(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1), arg2(a.arg2);
+    bool user_ok = false;
+    {
+        std::lock_guard<std::mutex> ulock(user_mutex);
+        util::load_user_db();
+        user_ok = user_db.count(arg2) > 0;
+    }
+    if (!user_ok) {
+        send_response(s.sock, "ERR|상대 유저 없음\n");
+        return;
+    }
+    if (!shares::is_clean_path(arg1)) {
+        send_response(s.sock, "ERR|공유할 수 없는 경로\n");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        meta::EntryMeta em;
+        if (!meta::stat_path(s.home, arg1, em)) {
+            send_response(s.sock, "ERR|경로 없음\n");
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> slock(share_mutex);
+        bool already = false;
+        for (auto it = share_map.lower_bound(arg2); it != share_map.upper_bound(arg2); ++it) {
+            if (it->second.first == s.username && it->second.second == arg1) {
+                already = true;
+                break;
+            }
+        }
+        if (already) {
+            send_response(s.sock, "ERR|이미 공유한 항목입니다\n");
+        } else {
+            share_map.insert({arg2, {s.username, arg1}});
+            util::save_share_map();
+            shares::reindex(arg2);
+            send_response(s.sock, "OK|공유 성공\n");
+        }
+    }
+}
+const command::Registrar reg_share("/share", cmd_share);
+
+void cmd_unshare(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1), arg2(a.arg2);
+    {
+        std::lock_guard<std::mutex> slock(share_mutex);
+        bool found = false;
+        for (auto it = share_map.lower_bound(arg2); it != share_map.upper_bound(arg2); ) {
+            if (it->second.first == s.username && it->second.second == arg1) {
+                it = share_map.erase(it);
+                found = true;
+            } else {
+                ++it;
+            }
+        }
+        if (found) {
+            util::save_share_map();
+            shares::reindex(arg2);
+            send_response(s.sock, "OK|공유 해제 성공\n");
+        } else {
+            send_response(s.sock, "ERR|공유 항목 없음\n");
+        }
+    }
+}
+const command::Registrar reg_unshare("/unshare", cmd_unshare);
+
+void cmd_sharedwithme(command::Session& s, const command::Args&) {
+    s.out.assign("OK|");
+    {
+        std::lock_guard<std::mutex> slock(share_mutex);
+        for (auto it = share_map.lower_bound(s.username); it != share_map.upper_bound(s.username); ++it)
+            s.out.append("[FROM ").append(it->second.first).append("] ").append(it->second.second).append("\n");
+    }
+    if (s.out.size() == 3) s.out.append("(공유받은 항목 없음)\n");
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_sharedwithme("/sharedwithme", cmd_sharedwithme);
+
+void cmd_ls(command::Session& s, const command::Args& a) {
+    s.path.assign(s.home);
+    if (!a.arg1.empty()) s.path.append("/").append(a.arg1);
+    s.out.assign("OK|");
+    bool listed;
+    {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        listed = meta::list_dir(s.path, s.out);
+    }
+    // 내 폴더에 없으면 공유받은 폴더(또는 그 하위)인지 확인해 소유자 폴더를 보여줌
+    meta::EntryMeta em;
+    std::string owner, arg1(a.arg1);
+    if (!listed && !arg1.empty() && resolve_shared(s.username, arg1, em, owner) && em.is_dir) {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        meta::list_dir(DATA_ROOT + owner + "/" + arg1, s.out);
+    } else if (!listed) {
+        s.out.append("(폴더 없음)\n");
+    }
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_ls("/ls", cmd_ls);
+
+void cmd_stat(command::Session& s, const command::Args& a) {
+    meta::EntryMeta em;
+    bool ok;
+    {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        ok = meta::stat_path(s.home, a.arg1, em);
+    }
+    std::string owner;
+    if (!ok) ok = resolve_shared(s.username, std::string(a.arg1), em, owner);
+    if (!ok) {
+        send_response(s.sock, "ERR|경로 없음\n");
+        return;
+    }
+    s.out.assign("OK|").append(em.is_dir ? "DIR" : "FILE").append("|");
+    command::append_num(s.out, em.size);
+    s.out.append("|");
+    command::append_num(s.out, em.mtime);
+    s.out.append("|\n");
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_stat("/stat", cmd_stat);
+
+void cmd_mkdir(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1);
+    std::string dir = s.home + "/" + arg1;
+    if (util::make_dir(dir)) {
+        {
+            std::lock_guard<std::mutex> ulock(usage_mutex);
+            usage::on_mkdir(s.username, arg1);
+        }
+        {
+            std::lock_guard<std::mutex> mlock(meta_mutex);
+            meta::refresh_entry(dir);
+        }
+        send_response(s.sock, "OK|폴더 생성 성공\n");
+    }
+    else
+        send_response(s.sock, "ERR|폴더 생성 실패\n");
+}
+const command::Registrar reg_mkdir("/mkdir", cmd_mkdir);
+
+// 휴지통으로 rename만 하고 바로 응답 (실제 삭제는 trash::purge_loop가 나중에)
+void cmd_rm(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1);
+    std::string path = s.home + "/" + arg1;
+    struct stat st;
+    bool existed = !arg1.empty() && arg1 != "." && stat(path.c_str(), &st) == 0;
+    long long bytes = existed ? st.st_size : 0;
+    if (existed && S_ISDIR(st.st_mode)) {
+        std::lock_guard<std::mutex> ulock(usage_mutex);
+        bytes = std::max(0LL, usage::dir_bytes(s.username, arg1));
+    }
+    if (existed && trash::move_in(s.username, arg1, S_ISDIR(st.st_mode), bytes)) {
+        {
+            std::lock_guard<std::mutex> ulock(usage_mutex);
+            usage::on_remove(s.username, arg1, S_ISDIR(st.st_mode), st.st_size);
+        }
+        {
+            std::lock_guard<std::mutex> mlock(meta_mutex);
+            meta::drop_subtree(path);
+            meta::refresh_entry(path);
+        }
+        digest::invalidate(path);
+        hot::invalidate(path);
+        {
+            std::lock_guard<std::mutex> slock(share_mutex);
+            shares::on_owner_remove(s.username, arg1);
+        }
+        if (trash::retention_days > 0)
+            send_response(s.sock, "OK|삭제 성공 (휴지통으로 이동, " + std::to_string(trash::retention_days) + "일 안에 /restore로 복구 가능)\n");
+        else
+            send_response(s.sock, "OK|삭제 성공\n");
+    }
+    else
+        send_response(s.sock, "ERR|삭제 실패\n");
+}
+const command::Registrar reg_rm("/rm", cmd_rm);
+
+// 인자 없으면 휴지통 목록, "경로" 또는 "#id"면 복구 (arg2가 있으면 그 경로로). 공유 설정은 되살리지 않는다.
+void cmd_restore(command::Session& s, const command::Args& a) {
+    if (a.arg1.empty()) {
+        send_response(s.sock, trash::describe(s.username));
+        return;
+    }
+    const std::string key(a.arg1), to(a.arg2);
+    trash::Item item;
+    if (!trash::peek(s.username, key, item)) {
+        send_response(s.sock, "ERR|복구 실패: 휴지통에 없는 항목\n");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> ulock(usage_mutex);
+        long long used = usage::used(s.username);
+        long long quota = usage::quota_of(s.username);
+        if (used + item.bytes > quota) {
+            send_response(s.sock, "ERR|용량 초과: 사용 " + std::to_string(used) + " / 한도 " + std::to_string(quota) + " bytes\n");
+            return;
+        }
+    }
+    std::vector<std::string> created;
+    std::string error = trash::restore(s.username, key, to, item, created);
+    if (!error.empty()) {
+        send_response(s.sock, "ERR|복구 실패: " + error + "\n");
+        return;
+    }
+    std::map<std::string, long long> subtree;
+    long long bytes = item.bytes;
+    if (item.is_dir) bytes = usage::scan(s.home, item.rel, subtree);
+    {
+        std::lock_guard<std::mutex> ulock(usage_mutex);
+        for (const auto& dir : created) usage::on_mkdir(s.username, dir);
+        usage::on_restore(s.username, item.rel, subtree, bytes);
+    }
+    {
+        // 복구하면서 새로 만든 상위 폴더도 목록 캐시에 반영
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        for (size_t slash = 0; (slash = item.rel.find('/', slash)) != std::string::npos; ++slash)
+            meta::refresh_entry(s.home + "/" + item.rel.substr(0, slash));
+        meta::refresh_entry(s.home + "/" + item.rel);
+    }
+    std::cout << "[안내] 사용자 '" << s.username << "' 휴지통에서 복구: " << item.rel << "\n";
+    send_response(s.sock, "OK|복구 완료: " + item.rel + "\n");
+}
+const command::Registrar reg_restore("/restore", cmd_restore);
+
+void cmd_mv(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1), arg2(a.arg2);
+    std::string from = s.home + "/" + arg1;
+    std::string to = s.home + "/" + arg2;
+    struct stat st, to_st;
+    bool existed = stat(from.c_str(), &st) == 0;
+    bool to_exists = stat(to.c_str(), &to_st) == 0;
+    // 같은 항목(같은 이름, 하드링크)으로의 이동은 rename이 아무것도 하지 않으므로 사용량/캐시도 그대로 둠
+    if (existed && to_exists && st.st_dev == to_st.st_dev && st.st_ino == to_st.st_ino) {
+        send_response(s.sock, "OK|이동/이름변경 성공\n");
+        return;
+    }
+    bool replaced = to_exists && S_ISREG(to_st.st_mode);
+    if (existed && util::move_path(from, to)) {
+        {
+            std::lock_guard<std::mutex> ulock(usage_mutex);
+            if (replaced) usage::on_remove(s.username, arg2, false, to_st.st_size);
+            usage::on_move(s.username, arg1, arg2, S_ISDIR(st.st_mode), st.st_size);
+        }
+        {
+            std::lock_guard<std::mutex> mlock(meta_mutex);
+            meta::drop_subtree(from);
+            meta::refresh_entry(from);
+            meta::refresh_entry(to.substr(0, to.find_last_of('/')));
+            meta::refresh_entry(to);
+        }
+        digest::invalidate(from);
+        digest::invalidate(to);
+        hot::invalidate(from);
+        hot::invalidate(to);
+        {
+            std::lock_guard<std::mutex> slock(share_mutex);
+            shares::on_owner_move(s.username, arg1, arg2);
+        }
+        send_response(s.sock, "OK|이동/이름변경 성공\n");
+    }
+    else
+        send_response(s.sock, "ERR|이동/이름변경 실패\n");
+}
+const command::Registrar reg_mv("/mv", cmd_mv);
+
+void cmd_upload(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1), arg2(a.arg2);
+    std::string fpath = s.home + "/" + arg1;
+    int filesize = stoi(arg2);
+    // 데이터 수신 전에 알려진 filesize로 용량 한도 검사 (덮어쓰기면 기존 크기 제외)
+    struct stat old_st;
+    long long old_size = (stat(fpath.c_str(), &old_st) == 0 && S_ISREG(old_st.st_mode)) ? old_st.st_size : 0;
+    {
+        std::lock_guard<std::mutex> ulock(usage_mutex);
+        long long used = usage::used(s.username);
+        long long quota = usage::quota_of(s.username);
+        if (used - old_size + filesize > quota) {
+            send_response(s.sock, "ERR|용량 초과: 사용 " + std::to_string(used) + " / 한도 " + std::to_string(quota) + " bytes\n");
+            return;
+        }
+    }
+    send_response(s.sock, "OK|READY\n");
+    size_t slash = fpath.find_last_of('/');
+    if (slash != std::string::npos)
+        util::ensure_dir(fpath.substr(0, slash));
+    std::ofstream ofs(fpath, std::ios::binary);
+    int received = 0;
+    bool write_ok = true;
+    // 받는 즉시 CRC32C(+블록별 CRC, 선택적 SHA-256)를 계산해 본문 뒤 트레일러와 비교
+    checksum::StreamChecksum sum(digest::strong);
+    bool ring_error = false;
+    if (uring::Ring* r = uring::ring()) {
+        int fd = open(fpath.c_str(), O_WRONLY);
+        if (fd >= 0) {
+            received = r->recv_file(s.sock, fd, filesize, write_ok,
+                                    [&sum](const char* data, size_t n) { sum.update(data, n); });
+            // 링 오류면 커널이 아직 소켓에서 받는 중일 수 있어 스트림 위치를 알 수 없으므로 이어 받지 않고 연결을 끊음
+            if (r->broken()) {
+                ring_error = true;
+                uring::discard(s.sock);
+            }
+            close(fd);
+            ofs.seekp(received);
+        }
+    }
+    while (!ring_error && write_ok && received < filesize) {
+        int to_read = std::min(BUFFER_SIZE, filesize - received);
+        int l = recv(s.sock, s.buffer, to_read, 0);
+        if (l <= 0) break;
+        ofs.write(s.buffer, l);
+        sum.update(s.buffer, l);
+        received += l;
+    }
+    ofs.close();
+    if (!write_ok) received = -1;
+    sum.finish();
+    std::string integrity_error;
+    if (ring_error) {
+        integrity_error = "서버 I/O 오류";
+    } else if (received == filesize) {
+        std::string line;
+        checksum::Trailer expected;
+        if (!recv_line(s.sock, line) || !checksum::parse_trailer(line, expected))
+            integrity_error = "체크섬 트레일러 없음";
+        else
+            integrity_error = checksum::verify(sum, expected);
+    }
+    bool ok = received == filesize && integrity_error.empty();
+    if (!ok) remove(fpath.c_str());
+    digest::invalidate(fpath);
+    hot::invalidate(fpath);
+    {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        meta::refresh_entry(fpath.substr(0, slash));
+        meta::refresh_entry(fpath);
+    }
+    if (!ok) {
+        if (received != filesize && !ring_error)
+            send_response(s.sock, "ERR|업로드 실패: 전송된 바이트(" + std::to_string(received) + ")와 파일 크기(" + std::to_string(filesize) + ") 불일치\n");
+        else
+            send_response(s.sock, "ERR|업로드 실패: 무결성 검증 오류 (" + integrity_error + ")\n");
+        {
+            std::lock_guard<std::mutex> ulock(usage_mutex);
+            usage::on_file_write(s.username, arg1, -old_size);
+        }
+        std::cout << "[경고] 사용자 '" << s.username << "' 파일 업로드 실패: " << arg1 << " (" << received << "/" << filesize << " bytes"
+                  << (integrity_error.empty() ? "" : ", " + integrity_error) << ")\n";
+    } else {
+        // 검증된 체크섬을 저장해 이후 조건부 다운로드/중복 검사에서 파일을 다시 읽지 않게 함
+        struct stat st;
+        if (stat(fpath.c_str(), &st) == 0) digest::put(fpath, st.st_size, st.st_mtime, sum);
+        {
+            std::lock_guard<std::mutex> ulock(usage_mutex);
+            usage::on_file_write(s.username, arg1, filesize - old_size);
+        }
+        send_response(s.sock, "OK|업로드 성공\n");
+        std::cout << "[안내] 사용자 '" << s.username << "' 파일 업로드: " << fpath << " (" << filesize << " bytes, crc32c "
+                  << checksum::crc_hex(sum.crc) << ")\n";
+    }
+    if (ring_error) s.quit = true;
+}
+const command::Registrar reg_upload("/upload", cmd_upload);
+
+void cmd_download(command::Session& s, const command::Args& a) {
+    const std::string& fpath = s.path;
+    s.path.assign(s.home).append("/").append(a.arg1);
+    meta::EntryMeta em;
+    bool found = false;
+    std::string owner;
+    bool own_file;
+    {
+        std::lock_guard<std::mutex> mlock(meta_mutex);
+        own_file = meta::stat_path(s.home, a.arg1, em) && !em.is_dir;
+    }
+    if (own_file) {
+        found = true;
+    } else if (resolve_shared(s.username, std::string(a.arg1), em, owner) && !em.is_dir) {
+        s.path.assign(DATA_ROOT).append(owner).append("/").append(a.arg1);
+        found = true;
+    }
+    if (!found) {
+        send_response(s.sock, "ERR|파일 없음\n");
+        return;
+    }
+    int filesize = em.size;
+    // 조건부 요청: 클라이언트 캐시의 "크기:수정시각:CRC32C"가 모두 같으면 본문 없이 NOTMOD
+    if (!a.arg2.empty()) {
+        std::string_view token = a.arg2;
+        std::string_view c_size = command::next_field(token, ':'), c_mtime = command::next_field(token, ':');
+        uint32_t crc;
+        if (command::to_num(c_size) == em.size && command::to_num(c_mtime) == (long long)em.mtime &&
+            digest::crc_of(fpath, em.size, em.mtime, crc) && token == checksum::crc_hex(crc)) {
+            send_response(s.sock, "OK|NOTMOD|\n");
+            return;
+        }
+    }
+    hot::Buffer blob = hot::lookup(fpath, em.size, em.mtime);
+    if (!blob && hot::admit(fpath, em.size)) blob = hot::load(fpath, em.size, em.mtime);
+    std::ifstream ifs;
+    if (!blob) {
+        ifs.open(fpath, std::ios::binary);
+        if (!ifs) {
+            send_response(s.sock, "ERR|파일 열기 실패\n");
+            return;
+        }
+    }
+    s.out.assign("OK|");
+    command::append_num(s.out, filesize);
+    s.out.append("|");
+    command::append_num(s.out, em.mtime);
+    s.out.append("|");
+    send_response(s.sock, s.out);
+    checksum::StreamChecksum sum(digest::strong);
+    int sent = 0;
+    int flow = bw::begin_flow(s.username, s.sock);
+    bool ring_error = false;
+    if (uring::Ring* r = uring::ring()) {
+        auto before_chunk = [flow](size_t n) { bw::acquire(flow, n); };
+        auto after_chunk = [&sum](const char* data, size_t n) { sum.update(data, n); };
+        int fd = -1;
+        if (blob) {
+            sent = r->send_buffer(s.sock, blob->data(), filesize, before_chunk, after_chunk);
+        } else {
+            fd = open(fpath.c_str(), O_RDONLY);
+            if (fd >= 0) sent = r->send_file(s.sock, fd, filesize, before_chunk, after_chunk);
+            ifs.seekg(sent);
+        }
+        // 링 오류면 남은 청크가 아직 커널에서 전송 중일 수 있으므로 이어 보내지 않고 연결을 끊음
+        if (r->broken()) {
+            ring_error = true;
+            uring::discard(s.sock);
+        }
+        if (fd >= 0) close(fd);
+    }
+    // io_uring 미사용 또는 (오류 없이) 중간에 멈춘 경우 기존 루프로 이어서 전송
+    while (!ring_error && sent < filesize) {
+        int tosend = std::min(BUFFER_SIZE, filesize - sent);
+        bw::acquire(flow, tosend);
+        const char* chunk = s.buffer;
+        if (blob) chunk = blob->data() + sent;
+        else ifs.read(s.buffer, tosend);
+        int l = send(s.sock, chunk, tosend, 0);
+        if (l <= 0) break;
+        sum.update(chunk, l);
+        sent += l;
+    }
+    (blob ? hot::bytes_from_cache : hot::bytes_from_disk) += sent;
+    bw::end_flow(flow);
+    if (!blob) ifs.close();
+    if (sent == filesize) {
+        // 보낸 바이트로 계산한 체크섬을 트레일러로 붙여 클라이언트가 블록 단위로 검증
+        sum.finish();
+        send_response(s.sock, sum.trailer());
+        digest::Entry stored;
+        if (!digest::find(fpath, em.size, em.mtime, stored))
+            digest::put(fpath, em.size, em.mtime, sum);
+        else if (stored.crc != sum.crc)
+            std::cerr << "[경고] 저장된 체크섬과 읽은 내용이 다름 (디스크 손상 의심): " << fpath << std::endl;
+    }
+    if (sent != filesize) {
+        std::cerr << "[다운로드 오류] 전송한 바이트(" << sent << ")와 파일 크기(" << filesize << ") 불일치: " << fpath << std::endl;
+    }
+    if (ring_error) s.quit = true;
+}
+const command::Registrar reg_download("/download", cmd_download);
+
+void cmd_search(command::Session& s, const command::Args& a) {
+    const std::string keyword(a.arg1);
+    std::vector<std::string> results;
+    meta::search(s.home, "", keyword, results);
+    std::vector<std::pair<std::string, std::string>> shared_items;
+    {
+        std::lock_guard<std::mutex> slock(share_mutex);
+        for (auto it = share_map.lower_bound(s.username); it != share_map.upper_bound(s.username); ++it)
+            if (shares::is_clean_path(it->second.second)) shared_items.push_back(it->second);
+    }
+    // 공유받은 항목 이름 + 공유받은 폴더 안쪽은 소유자 트리에서 검색
+    std::set<std::string> seen;
+    for (const auto& item : shared_items) {
+        std::vector<std::string> found;
+        if (item.second.find(keyword) != std::string::npos) found.push_back(item.second);
+        meta::search(DATA_ROOT + item.first, item.second, keyword, found);
+        for (const auto& f : found) {
+            std::string shared_from = "[공유:" + item.first + "] " + f;
+            if (seen.insert(shared_from).second) results.push_back(shared_from);
+        }
+    }
+    s.out.assign("OK|");
+    if (results.empty()) s.out.append("(검색 결과 없음)\n");
+    for (const auto& r : results) s.out.append(r).append("\n");
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_search("/search", cmd_search);
+
+void cmd_du(command::Session& s, const command::Args& a) {
+    const std::string arg1(a.arg1);
+    std::lock_guard<std::mutex> ulock(usage_mutex);
+    long long bytes = usage::dir_bytes(s.username, arg1);
+    if (bytes < 0) {
+        send_response(s.sock, "ERR|폴더 없음\n");
+        return;
+    }
+    s.out.assign("OK|/").append(arg1).append(" : ");
+    command::append_num(s.out, bytes);
+    s.out.append(" bytes (전체 사용 ");
+    command::append_num(s.out, usage::used(s.username));
+    s.out.append(" / 한도 ");
+    command::append_num(s.out, usage::quota_of(s.username));
+    s.out.append(" bytes)\n");
+    send_response(s.sock, s.out);
+}
+const command::Registrar reg_du("/du", cmd_du);
+
+void cmd_quit(command::Session& s, const command::Args&) {
+    std::cout << "[안내] 사용자 '" << s.username << "' 연결 종료\n";
+    s.quit = true;
+}
+const command::Registrar reg_quit("/quit", cmd_quit);
+
+// ---- 클라이언트 1명당 1스레드: 명령 반복 처리 루프 ----
+void handle_client(int client_sock) {
+    command::Session s;
+    s.sock = client_sock;
+    bool logged_in = false;
+
+    send_response(client_sock, "OK|로그인 또는 회원가입 선택: (1) 로그인 (2) 회원가입 입력\n");
+
+    while (!logged_in) {
+        int len = recv(client_sock, s.buffer, sizeof(s.buffer), 0);
+        if (len <= 0) return;
+        command::Args a = command::parse(std::string_view(s.buffer, len));
+        std::string_view mode = a.name;
+        std::string id(a.arg1), pw(a.arg2);
+
+        std::string response;
+        if ((mode == "1" || mode == "2") && !cluster::is_local(id)) {
+            // 이 유저의 담당 노드가 아니면 담당 노드 주소를 알려줌 (클라이언트가 재접속)
+            const cluster::Node& owner = cluster::owner_of(id);
+            send_response(client_sock, "ERR|REDIRECT|" + owner.host + ":" + std::to_string(owner.port) + "|\n");
+            continue;
+        }
+        if (mode == "1") {
+            if (try_login(id, pw, response)) {
+                s.username = id;
+                logged_in = true;
+                util::ensure_user_dir(s.username);
+                std::cout << "[안내] 사용자 '" << s.username << "' 로그인/접속\n";
+            }
+            send_response(client_sock, response);
+        }
+        else if (mode == "2") {
+            if (try_signup(id, pw, response)) {
+                s.username = id;
+                logged_in = true;
+                util::ensure_user_dir(s.username);
+                std::cout << "[안내] 사용자 '" << s.username << "' 회원가입 및 접속\n";
+            }
+            send_response(client_sock, response);
+        }
+        else {
+            send_response(client_sock, "ERR|1 또는 2만 입력 가능\n");
+        }
+    }
+    const std::string& username = s.username;
+    s.home = DATA_ROOT + username;
+    s.out.reserve(BUFFER_SIZE);
+    s.path.reserve(256);
+
+    {
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        user_conn[username] = client_sock;
+    }
+    usage::ensure_loaded(username);
+    {
+        std::lock_guard<std::mutex> lock(meta_mutex);
+        meta::get_dir(s.home);
+    }
+
+    while (!s.quit) {
+        int len = recv(client_sock, s.buffer, sizeof(s.buffer), 0);
+        if (len <= 0) break;
+        command::Args a = command::parse(std::string_view(s.buffer, len));
+        if (command::Handler handler = command::find(a.name))
+            handler(s, a);
+        else
+            send_response(client_sock, "ERR|알 수 없는 명령\n");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        if (!username.empty()) user_conn.erase(username);
+    }
+    if (!username.empty()) {
+        std::lock_guard<std::mutex> lock(meta_mutex);
+        meta::drop_subtree(s.home);
+    }
+    {
+        std::lock_guard<std::mutex> lock(usage_mutex);
+        if (usage_dirty.count(username)) usage::save(username);
+    }
+    close(client_sock);
+}
+
+// ---- 서버 콘솔 명령: 대역폭 설정 변경, 트래픽 통계 조회 ----
+void console_loop() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream iss(line);
+        std::string cmd;
+        iss >> cmd;
+        if (cmd.empty()) continue;
+        if (cmd == "bw") {
+            if (iss >> std::ws, iss.eof()) std::cout << bw::describe();
+            else std::cout << bw::configure(iss);
+        }
+        else if (cmd == "cluster") {
+            std::string user;
+            std::cout << cluster::describe();
+            while (iss >> user) std::cout << "  " << user << " -> " << cluster::owner_of(user).id << "\n";
+        }
+        else if (cmd == "metrics") {
+            std::cout << bw::metrics() << hot::stats();
+        }
+        else {
+            std::cout << "[콘솔] 명령: bw [global|user|conn|weight ...], metrics (트래픽/파일 캐시 통계), cluster [유저...]\n";
+        }
+        std::cout << std::flush;
+    }
+}
+
+// ---- I/O 벤치마크 (./server --bench-io [MB]) ----
+// 루프백 TCP로 기존 8KB 루프와 io_uring 경로의 처리량, GB당 시스템콜 수를 비교한다.
+namespace bench {
+    // /proc/thread-self/io 의 syscr/syscw (현재 스레드의 read/write 계열 시스템콜 수)
+    long long thread_rw_syscalls() {
+        std::ifstream ifs("/proc/thread-self/io");
+        std::string key;
+        long long value, total = 0;
+        while (ifs >> key >> value)
+            if (key == "syscr:" || key == "syscw:") total += value;
+        return total;
+    }
+    struct Result {
+        double seconds = 0;
+        long long syscalls = 0;
+        long long bytes = 0;
+    };
+    void report(const char* name, const Result& r) {
+        double gb = r.bytes / (1024.0 * 1024 * 1024);
+        std::cout << "  " << name << ": " << (long long)(r.bytes / (1024.0 * 1024) / r.seconds) << " MB/s, "
+                  << "GB당 시스템콜 " << (long long)(r.syscalls / gb) << "\n";
+    }
+    // 루프백 TCP 연결 한 쌍
+    bool socket_pair(int& a, int& b) {
+        int ls = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t alen = sizeof(addr);
+        if (ls < 0 || bind(ls, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(ls, 1) < 0 ||
+            getsockname(ls, (sockaddr*)&addr, &alen) < 0) return false;
+        a = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(a, (sockaddr*)&addr, sizeof(addr)) < 0) return false;
+        b = accept(ls, nullptr, nullptr);
+        close(ls);
+        return b >= 0;
+    }
+    // 다운로드 방향: 파일 -> 소켓 (반대편 스레드가 읽어서 버림)
+    Result download(const std::string& path, long long size, bool use_uring) {
+        int tx, rx;
+        Result r;
+        if (!socket_pair(tx, rx)) return r;
+        std::thread drain([rx, size]() {
+            std::vector<char> sink(256 * 1024);
+            long long got = 0;
+            while (got < size) {
+                ssize_t l = recv(rx, sink.data(), sink.size(), 0);
+                if (l <= 0) break;
+                got += l;
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        long long before = thread_rw_syscalls(), enters = uring::enter_calls, sends = 0;
+        if (use_uring) {
+            int fd = open(path.c_str(), O_RDONLY);
+            r.bytes = uring::ring()->send_file(tx, fd, size, [](size_t) {}, [](const char*, size_t) {});
+            close(fd);
+        } else {
+            // handle_client의 기존 다운로드 루프와 동일
+            std::ifstream ifs(path, std::ios::binary);
+            char buffer[BUFFER_SIZE];
+            while (r.bytes < size) {
+                int tosend = std::min<long long>(BUFFER_SIZE, size - r.bytes);
+                ifs.read(buffer, tosend);
+                int l = send(tx, buffer, tosend, 0);
+                ++sends;
+                if (l <= 0) break;
+                r.bytes += l;
+            }
+        }
+        r.syscalls = thread_rw_syscalls() - before + (uring::enter_calls - enters) + sends;
+        drain.join();
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        close(tx);
+        close(rx);
+        return r;
+    }
+    // 업로드 방향: 소켓 -> 파일 (반대편 스레드가 계속 보냄)
+    Result upload(const std::string& path, long long size, bool use_uring) {
+        int tx, rx;
+        Result r;
+        if (!socket_pair(tx, rx)) return r;
+        std::thread feeder([tx, size]() {
+            std::vector<char> src(256 * 1024, 'u');
+            long long sent = 0;
+            while (sent < size) {
+                ssize_t l = send(tx, src.data(), std::min<long long>(src.size(), size - sent), 0);
+                if (l <= 0) break;
+                sent += l;
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        long long before = thread_rw_syscalls(), enters = uring::enter_calls, recvs = 0;
+        if (use_uring) {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool write_ok;
+            r.bytes = uring::ring()->recv_file(rx, fd, size, write_ok, [](const char*, size_t) {});
+            close(fd);
+        } else {
+            // handle_client의 기존 업로드 루프와 동일
+            std::ofstream ofs(path, std::ios::binary);
+            char buffer[BUFFER_SIZE];
+            while (r.bytes < size) {
+                int to_read = std::min<long long>(BUFFER_SIZE, size - r.bytes);
+                int l = recv(rx, buffer, to_read, 0);
+                ++recvs;
+                if (l <= 0) break;
+                ofs.write(buffer, l);
+                r.bytes += l;
+            }
+        }
+        r.syscalls = thread_rw_syscalls() - before + (uring::enter_calls - enters) + recvs;
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        feeder.join();
+        close(tx);
+        close(rx);
+        return r;
+    }
+    int run(long long mb) {
+        const std::string path = "server_data/.bench_io.tmp";
+        const long long size = mb * 1024 * 1024;
+        util::ensure_dir("server_data");
+        {
+            std::ofstream ofs(path, std::ios::binary);
+            std::vector<char> block(1024 * 1024);
+            for (size_t i = 0; i < block.size(); ++i) block[i] = (char)(i * 131 + 7);
+            for (long long i = 0; i < mb; ++i) ofs.write(block.data(), block.size());
+        }
+        std::cout << "[벤치마크] " << mb << "MB, 루프백 TCP\n";
+        download(path, size, false);    // 페이지 캐시 예열
+        std::cout << "다운로드 (파일 -> 소켓)\n";
+        report("기존 8KB 루프", download(path, size, false));
+        if (uring::ring()) report("io_uring      ", download(path, size, true));
+        std::cout << "업로드 (소켓 -> 파일)\n";
+        report("기존 8KB 루프", upload(path, size, false));
+        if (uring::ring()) report("io_uring      ", upload(path, size, true));
+        if (!uring::ring()) std::cout << "  (io_uring 사용 불가로 기존 경로만 측정)\n";
+        remove(path.c_str());
+        return 0;
     }
-    close(client_sock);
 }
 
 // ---- 서버 메인 함수: listen, accept, 스레드 분기 ----
-int main() {
+int main(int argc, char** argv) {
+    bool allow_uring = true;
+    long long bench_mb = 0;
+    int port = PORT;
+    std::string node_id, peers, workdir;
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        bool has_value = i + 1 < argc;
+        if (opt == "--no-uring") allow_uring = false;
+        else if (opt == "--strong-hash") digest::strong = true;
+        else if (opt == "--trash-days" && has_value) trash::retention_days = std::max(0, atoi(argv[++i]));
+        else if (opt == "--bench-io") bench_mb = (has_value && isdigit(argv[i + 1][0])) ? atoll(argv[++i]) : 256;
+        else if (opt == "--port" && has_value) port = atoi(argv[++i]);
+        else if (opt == "--node" && has_value) node_id = argv[++i];
+        else if (opt == "--peers" && has_value) peers = argv[++i];
+        else if (opt == "--cluster-secret" && has_value) cluster::secret = argv[++i];
+        else if (opt == "--workdir" && has_value) workdir = argv[++i];
+        else {
+            std::cerr << "사용법: " << argv[0] << " [--port 포트] [--workdir 폴더] [--node 이름 --peers 이름=IP:포트,... [--cluster-secret 비밀]]"
+                      << " [--no-uring] [--strong-hash] [--trash-days 일수] [--bench-io [MB]]\n";
+            return 1;
+        }
+    }
+    // server_data/ 는 상대경로이므로 같은 호스트의 여러 노드는 작업 폴더로 구분
+    if (!workdir.empty()) {
+        util::ensure_dir(workdir);
+        if (chdir(workdir.c_str()) != 0) { std::cerr << "작업 폴더 이동 실패: " << workdir << "\n"; return 1; }
+    }
+    if (!node_id.empty() || !peers.empty()) {
+        if (!cluster::configure(node_id, peers)) {
+            std::cerr << "클러스터 설정 오류: --node 이름이 --peers 목록에 있어야 합니다\n";
+            return 1;
+        }
+        port = cluster::self()->port;
+        std::thread(peer_listen_loop, port + cluster::PEER_PORT_OFFSET).detach();
+        std::cout << cluster::describe();
+        if (cluster::secret.empty())
+            std::cout << "[안내] --cluster-secret 없음: 내부 요청은 --peers의 노드 주소로만 확인합니다\n";
+    }
+    uring::init(allow_uring);
+    if (bench_mb > 0) return bench::run(bench_mb);
     util::ensure_dir("server_data");
     util::ensure_dir(DATA_ROOT);
     { std::ofstream touch(USER_DB_FILE, std::ios::app); touch.close(); }
@@ -498,11 +3407,24 @@ int main() {
         std::lock_guard<std::mutex> lock(share_mutex);
         util::load_share_map();
     }
+    {
+        std::lock_guard<std::mutex> lock(usage_mutex);
+        usage::load_quota();
+    }
+    digest::load();
+    trash::load();
+    std::thread(usage::reconcile_loop).detach();
+    meta::init();
+    std::thread(history::commit_loop).detach();
+    std::thread(trash::purge_loop).detach();
+    std::thread(console_loop).detach();
     int serv_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (serv_sock < 0) { std::cerr << "소켓 생성 실패\n"; return 1; }
+    int yes = 1;
+    setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));   // 재시작 시 TIME_WAIT 포트 재사용
     sockaddr_in serv_addr;
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(port);
     serv_addr.sin_addr.s_addr = INADDR_ANY;
     if (bind(serv_sock, (sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
         std::cerr << "바인드 실패\n"; return 2;
@@ -510,7 +3432,7 @@ int main() {
     if (listen(serv_sock, 5) < 0) {
         std::cerr << "리스닝 실패\n"; return 3;
     }
-    std::cout << "서버 시작: 포트 " << PORT << std::endl;
+    std::cout << "서버 시작: 포트 " << port << std::endl;
     while (true) {
         int cli_sock = accept(serv_sock, nullptr, nullptr);
         if (cli_sock < 0) continue;
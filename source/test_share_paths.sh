@@ -0,0 +1,92 @@
+#!/bin/bash
+# 공유 경로 권한 검사 테스트: "공유폴더/../" 형태로 공유 범위 밖 파일에 접근할 수 없어야 한다
+# 사용법: ./test_share_paths.sh [포트(기본 9401)]
+#   - 임시 작업 폴더에서 서버를 띄우고 alice(proj2만 bob에게 공유), bob, carol 계정으로 확인
+#   - 모두 통과하면 종료 코드 0, 하나라도 실패하면 1
+set -e
+cd "$(dirname "$0")"
+
+PORT=${1:-9401}
+WORK=$(mktemp -d)
+g++ -std=c++17 -O2 server_FileChat.cpp -o "$WORK/server" -pthread
+
+mkdir -p "$WORK/server_data/users/alice/proj2" "$WORK/server_data/users/carol"
+echo "shared" > "$WORK/server_data/users/alice/proj2/ok.txt"
+echo "secret" > "$WORK/server_data/users/alice/private.txt"
+echo "diary" > "$WORK/server_data/users/carol/diary.txt"
+
+(cd "$WORK" && exec ./server --port "$PORT" < /dev/null > server.log 2>&1) &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WORK"' EXIT
+sleep 0.5
+
+FAILED=0
+# 한 명령을 보내고 응답(여러 줄 가능)을 REPLY_TEXT에 모음
+send() {
+    printf '%s' "$1" >&3
+    REPLY_TEXT=""
+    local line
+    while IFS= read -r -t 0.3 line <&3; do REPLY_TEXT+="$line"$'\n'; done
+}
+login() {
+    exec 3<>"/dev/tcp/127.0.0.1/$PORT"
+    send ""
+    send "2|$1|pw|"
+}
+logout() {
+    send "/quit|||"
+    exec 3<&-
+}
+expect() {
+    local want=$1 cmd=$2
+    send "$cmd"
+    if [[ "$REPLY_TEXT" == "$want"* ]]; then
+        echo "[통과] $cmd -> ${REPLY_TEXT%%$'\n'*}"
+    else
+        echo "[실패] $cmd: '$want' 기대, 응답 '${REPLY_TEXT%%$'\n'*}'"
+        FAILED=1
+    fi
+}
+expect_absent() {
+    local word=$1 cmd=$2
+    send "$cmd"
+    if [[ "$REPLY_TEXT" == *"$word"* ]]; then
+        echo "[실패] $cmd: 응답에 '$word' 노출"
+        FAILED=1
+    else
+        echo "[통과] $cmd -> '$word' 없음"
+    fi
+}
+
+for user in carol bob; do
+    login $user
+    logout
+done
+
+login alice
+expect "OK" "/share|proj2|bob|"
+expect "ERR" "/share|proj2/../private.txt|bob|"
+expect "ERR" "/share|../carol|bob|"
+logout
+
+exec 3<>"/dev/tcp/127.0.0.1/$PORT"
+send ""
+send "1|bob|pw|"
+expect "ERR" "/download|proj2/../private.txt||"
+expect "ERR" "/download|proj2/../../carol/diary.txt||"
+expect "ERR" "/download|proj2/./../private.txt||"
+expect "ERR" "/download|proj2//../private.txt||"
+expect "ERR" "/stat|proj2/../private.txt|"
+expect "ERR" "/stat|proj2/../../carol/diary.txt|"
+expect_absent "private.txt" "/ls|proj2/..|"
+expect_absent "diary.txt" "/ls|proj2/../../carol|"
+expect_absent "diary" "/search|diary|"
+expect "OK|FILE" "/stat|proj2/ok.txt|"
+expect "OK|" "/download|proj2/ok.txt||"
+exec 3<&-
+
+if [ $FAILED -ne 0 ]; then
+    echo "[결과] 실패"
+    exit 1
+fi
+echo "[결과] 모두 통과"